@@ -13,6 +13,7 @@
 // - Entire shading computation is done in the Eye Frame (in shader).
 // --------------------------------------------------------------------------  
 #include "Angel-yjc.h"
+#include "TransformTree.h"
 
 typedef Angel::vec4  color4;
 typedef Angel::vec4  point4;
@@ -32,7 +33,7 @@ point4 points[NumVertices];
 vec3   normals[NumVertices];
 
 // Vertices of a unit cube centered at origin, sides aligned with axes
-point4 vertices[8] = {
+constexpr point4 vertices[8] = {
 	point4(-0.5, -0.5,  0.5, 1.0),
 	point4(-0.5,  0.5,  0.5, 1.0),
 	point4(0.5,  0.5,  0.5, 1.0),
@@ -51,28 +52,39 @@ GLfloat  Theta[NumAxes] = { 0.0, 0.0, 0.0 };
 // Model-view and projection matrices uniform location
 GLuint  ModelView, Projection;
 
+// Viewer
+constexpr vec3 viewer_pos(0.0, 0.0, 2.0);  // for the "#if 0" model-view in display()
+constexpr vec4 eye(3.0, 2.0, 0.0, 1.0);
+constexpr vec4 at(0.0, 0.0, 0.0, 1.0);
+constexpr vec4 up(0.0, 1.0, 0.0, 0.0);
+
+// The view, with the cube as its child: world(cubeNode) is the cube's
+// model-view.  idle() sets the cube's local transform when it turns.
+TransformTree transforms;
+TransformTree::Node viewNode, cubeNode;
+
 /*----- Shader Lighting Parameters -----*/
-color4 light_ambient(0.2, 0.2, 0.2, 1.0);
-color4 light_diffuse(1.0, 1.0, 1.0, 1.0);
-color4 light_specular(1.0, 1.0, 1.0, 1.0);
+constexpr color4 light_ambient(0.2, 0.2, 0.2, 1.0);
+constexpr color4 light_diffuse(1.0, 1.0, 1.0, 1.0);
+constexpr color4 light_specular(1.0, 1.0, 1.0, 1.0);
 float const_att = 1.0;
 float linear_att = 0.01;
 float quad_att = 0.01;
-point4 light_position(2.0, 2.0, 1.0, 1.0);
+constexpr point4 light_position(2.0, 2.0, 1.0, 1.0);
 // In World frame.
 // Needs to transform it to Eye Frame
 // before sending it to the shader(s).
 
-color4 material_ambient(1.0, 0.0, 1.0, 1.0);
-color4 material_diffuse(1.0, 0.8, 0.0, 1.0);
-color4 material_specular(1.0, 0.8, 0.0, 1.0);
+constexpr color4 material_ambient(1.0, 0.0, 1.0, 1.0);
+constexpr color4 material_diffuse(1.0, 0.8, 0.0, 1.0);
+constexpr color4 material_specular(1.0, 0.8, 0.0, 1.0);
 float  material_shininess = 100.0;
 
 color4 ambient_product = light_ambient * material_ambient;
 color4 diffuse_product = light_diffuse * material_diffuse;
 color4 specular_product = light_specular * material_specular;
 
-void SetUp_Lighting_Uniform_Vars(mat4 mv);
+void SetUp_Lighting_Uniform_Vars(const affine& mv);
 
 int Index = 0;
 
@@ -107,11 +119,23 @@ void colorcube()
 	quad(5, 4, 0, 1);
 }
 //----------------------------------------------------------------------------
+// The cube's model transform for the current Theta
+affine cubeModel()
+{
+	return Scale(1.4, 1.4, 1.4) *
+		RotateX(Theta[Xaxis]) *
+		RotateY(Theta[Yaxis]) *
+		RotateZ(Theta[Zaxis]);
+}
+//----------------------------------------------------------------------------
 // OpenGL initialization
 void init()
 {
 	colorcube();
 
+	viewNode = transforms.add(TransformTree::Root, LookAt(eye, at, up)); // Correct LookAt()
+	cubeNode = transforms.add(viewNode, cubeModel());
+
 	// Create and initialize a vertex buffer object
 	glGenBuffers(1, &cube_buffer);
 	glBindBuffer(GL_ARRAY_BUFFER, cube_buffer);
@@ -129,14 +153,14 @@ void init()
 }
 
 //----------------------------------------------------------------------
-// SetUp_Lighting_Uniform_Vars(mat4 mv):
+// SetUp_Lighting_Uniform_Vars(const affine& mv):
 // Set up lighting parameters that are uniform variables in shader.
 //
 // Note: "LightPosition" in shader must be in the Eye Frame.
 //       So we use parameter "mv", the model-view matrix, to transform
 //       light_position to the Eye Frame.
 //----------------------------------------------------------------------
-void SetUp_Lighting_Uniform_Vars(mat4 mv)
+void SetUp_Lighting_Uniform_Vars(const affine& mv)
 {
 	glUniform4fv(glGetUniformLocation(program, "AmbientProduct"),
 		1, ambient_product);
@@ -210,12 +234,10 @@ void display(void)
 	mat4  p = Perspective(fovy, aspect, zNear, zFar);
 	glUniformMatrix4fv(Projection, 1, GL_TRUE, p); // GL_TRUE: matrix is row-major
 
-	// Generate the model-view matrix
-	const vec3 viewer_pos(0.0, 0.0, 2.0);
-	const vec4 eye(3.0, 2.0, 0.0, 1.0);
-	vec4 at(0.0, 0.0, 0.0, 1.0);
-	vec4 up(0.0, 1.0, 0.0, 0.0);
-	mat4 mv = LookAt(eye, at, up); // model-view matrix using Correct LookAt()
+	// The model-view matrices, recomputed only if something moved since
+	// the last frame
+	transforms.update();
+	const affine& mv = transforms.world(viewNode);
 		 // model-view matrix for the light position.
 
 /*--- Set up lighting parameters that are uniform variables in shader ---*/
@@ -226,11 +248,9 @@ void display(void)
 //        set up.
 	SetUp_Lighting_Uniform_Vars(mv);
 
-	// The model-view matrix with all transformations for the cube
-	mat4  model_view = mv * Scale(1.4, 1.4, 1.4) *
-		RotateX(Theta[Xaxis]) *
-		RotateY(Theta[Yaxis]) *
-		RotateZ(Theta[Zaxis]);
+	// The model-view matrix with all transformations for the cube.  It
+	// stays an affine and becomes a mat4 only for the upload.
+	const affine& model_view = transforms.world(cubeNode);
 
 #if 0
 	mat4  model_view = (Translate(-viewer_pos) *
@@ -239,16 +259,11 @@ void display(void)
 		RotateZ(Theta[Zaxis]));
 #endif
 
-	glUniformMatrix4fv(ModelView, 1, GL_TRUE, model_view);
+	glUniformMatrix4fv(ModelView, 1, GL_TRUE, mat4(model_view));
 
-	// Set up the Normal Matrix from the model-view matrix
-	mat3 normal_matrix = NormalMatrix(model_view, 1);
-	// Flag in NormalMatrix(): 
-	//    1: model_view involves non-uniform scaling
-//    0: otherwise.
-// Using 1 is always correct.  
-// But if no non-uniform scaling, 
-	//     using 0 is faster (avoids matrix inverse computation).
+	// The Normal Matrix of the model-view matrix, cached with it (closed
+	// form for an affine, correct under non-uniform scaling as well)
+	const mat3& normal_matrix = transforms.normal(cubeNode);
 
 	glUniformMatrix3fv(glGetUniformLocation(program, "Normal_Matrix"),
 		1, GL_TRUE, normal_matrix);
@@ -277,6 +292,7 @@ void idle(void)
 	if (Theta[Axis] > 360.0) {
 		Theta[Axis] -= 360.0;
 	}
+	transforms.setLocal(cubeNode, cubeModel());
 
 	glutPostRedisplay();
 }
@@ -39,6 +39,22 @@
 //          upper-left 3x3 submatrix is m, the 4th column and the 4th row are
 //          both (0, 0, 0, 1).
 //                  
+//  7. The mat2/mat3/mat4 constructors, Translate(), Scale() and Ortho() are
+//     constexpr, so constant matrices can be built at compile time, e.g.
+//     constexpr mat4 m = Translate(0.0, 1.0, 0.0);
+//
+//  8. Translate(), Scale() and the Rotate functions return translation,
+//     scaling and affine, which convert to mat4 but multiply more cheaply
+//     (see "Structured transforms" below).
+//
+//  9. rigid is a rotation, a translation and a uniform scale; LookAt()
+//     returns one.  inverse() and NormalMatrix() have closed forms for
+//     rigid and affine that never leave float and never exit.
+//
+// 10. quat is a unit quaternion for accumulating rotations; RotateQuat()
+//     makes one from Rotate()'s arguments and Rotate(q) converts it;
+//     pow(q, t) repeats it t times.
+//
 //////////////////////////////////////////////////////////////////////////////
 
 #ifndef __ANGEL_MAT_H__
@@ -67,29 +83,25 @@ class mat2 {
     //  --- Constructors and Destructors ---
     //
 
-    mat2( const GLfloat d = GLfloat(1.0) )  // Create a diagional matrix
-	{ _m[0].x = d;  _m[1].y = d;   }
+    constexpr mat2( const GLfloat d = GLfloat(1.0) )  // Create a diagional matrix
+	: _m{ vec2( d, 0.0 ), vec2( 0.0, d ) } {}
 
-    mat2( const vec2& a, const vec2& b )
-	{ _m[0] = a;  _m[1] = b;  }
+    constexpr mat2( const vec2& a, const vec2& b )
+	: _m{ a, b } {}
 
-    mat2( GLfloat m00, GLfloat m10, GLfloat m01, GLfloat m11 )   //YJC: These 4 items are given in *column order,
+    constexpr mat2( GLfloat m00, GLfloat m10, GLfloat m01, GLfloat m11 )   //YJC: These 4 items are given in *column order,
                                                                  //     but the matrix is stored in *row order*.
-      { _m[0] = vec2( m00, m01 ); _m[1] = vec2( m10, m11 ); }    //YJC: This is in row order.
+      : _m{ vec2( m00, m01 ), vec2( m10, m11 ) } {}              //YJC: This is in row order.
 
-    mat2( const mat2& m ) {
-	if ( *this != m ) {
-	    _m[0] = m._m[0];
-	    _m[1] = m._m[1];
-	} 
-    }
+    constexpr mat2( const mat2& m )
+	: _m{ m._m[0], m._m[1] } {}
 
     //
     //  --- Indexing Operator ---
     //
 
     vec2& operator [] ( int i ) { return _m[i]; }
-    const vec2& operator [] ( int i ) const { return _m[i]; }
+    constexpr const vec2& operator [] ( int i ) const { return _m[i]; }
 
     //
     //  --- (non-modifying) Arithmatic Operators ---
@@ -252,37 +264,29 @@ class mat3 {
     //  --- Constructors and Destructors ---
     //
 
-    mat3( const GLfloat d = GLfloat(1.0) )  // Create a diagional matrix
-	{ _m[0].x = d;  _m[1].y = d;  _m[2].z = d;   }
+    constexpr mat3( const GLfloat d = GLfloat(1.0) )  // Create a diagional matrix
+	: _m{ vec3( d, 0.0, 0.0 ), vec3( 0.0, d, 0.0 ), vec3( 0.0, 0.0, d ) } {}
 
-    mat3( const vec3& a, const vec3& b, const vec3& c )
-	{ _m[0] = a;  _m[1] = b;  _m[2] = c;  }
+    constexpr mat3( const vec3& a, const vec3& b, const vec3& c )
+	: _m{ a, b, c } {}
 
-    mat3( GLfloat m00, GLfloat m10, GLfloat m20,
+    constexpr mat3( GLfloat m00, GLfloat m10, GLfloat m20,
 	  GLfloat m01, GLfloat m11, GLfloat m21,
 	  GLfloat m02, GLfloat m12, GLfloat m22 ) //YJC: These 9 items are given in *column order*,
                                                   //     but the matrix is stored in *row order*.
-	{
-	    _m[0] = vec3( m00, m01, m02 );        //YJC: This is in row order.
-	    _m[1] = vec3( m10, m11, m12 );
-	    _m[2] = vec3( m20, m21, m22 );
-	}
+	: _m{ vec3( m00, m01, m02 ),              //YJC: This is in row order.
+	      vec3( m10, m11, m12 ),
+	      vec3( m20, m21, m22 ) } {}
 
-    mat3( const mat3& m )
-	{
-	    if ( *this != m ) {
-		_m[0] = m._m[0];
-		_m[1] = m._m[1];
-		_m[2] = m._m[2];
-	    } 
-	}
+    constexpr mat3( const mat3& m )
+	: _m{ m._m[0], m._m[1], m._m[2] } {}
 
     //
     //  --- Indexing Operator ---
     //
 
     vec3& operator [] ( int i ) { return _m[i]; }
-    const vec3& operator [] ( int i ) const { return _m[i]; }
+    constexpr const vec3& operator [] ( int i ) const { return _m[i]; }
 
     //
     //  --- (non-modifying) Arithmatic Operators ---
@@ -488,16 +492,17 @@ class mat4 {
     //  --- Constructors and Destructors ---
     //
 
-    mat4( const GLfloat d = GLfloat(1.0) )  // Create a diagional matrix
-	{ _m[0].x = d;  _m[1].y = d;  _m[2].z = d;  _m[3].w = d; }
+    constexpr mat4( const GLfloat d = GLfloat(1.0) )  // Create a diagional matrix
+	: _m{ vec4( d, 0.0, 0.0, 0.0 ), vec4( 0.0, d, 0.0, 0.0 ),
+	      vec4( 0.0, 0.0, d, 0.0 ), vec4( 0.0, 0.0, 0.0, d ) } {}
 
-    mat4( const vec4& a, const vec4& b, const vec4& c, const vec4& d )
-	{ _m[0] = a;  _m[1] = b;  _m[2] = c;  _m[3] = d; }
+    constexpr mat4( const vec4& a, const vec4& b, const vec4& c, const vec4& d )
+	: _m{ a, b, c, d } {}
             //
            // YJC: a becomes the first row, b the 2nd row,
            //      c the 3rd row, d the 4th row.
 
-    mat4( GLfloat m00, GLfloat m10, GLfloat m20, GLfloat m30,
+    constexpr mat4( GLfloat m00, GLfloat m10, GLfloat m20, GLfloat m30,
 	  GLfloat m01, GLfloat m11, GLfloat m21, GLfloat m31,
 	  GLfloat m02, GLfloat m12, GLfloat m22, GLfloat m32,
 	  GLfloat m03, GLfloat m13, GLfloat m23, GLfloat m33 )
@@ -505,29 +510,20 @@ class mat4 {
             //YJC: These 16 items are given in *column order*,
             //     but the matrix is stored in *row order*.
             //
-	{
-	    _m[0] = vec4( m00, m01, m02, m03 );  //YJC: This is in row order:
-	    _m[1] = vec4( m10, m11, m12, m13 );  //     _m[0] is the first row,
-	    _m[2] = vec4( m20, m21, m22, m23 );  //     _m[1] the 2nd row, etc.
-	    _m[3] = vec4( m30, m31, m32, m33 );
-	}
+	: _m{ vec4( m00, m01, m02, m03 ),  //YJC: This is in row order:
+	      vec4( m10, m11, m12, m13 ),  //     _m[0] is the first row,
+	      vec4( m20, m21, m22, m23 ),  //     _m[1] the 2nd row, etc.
+	      vec4( m30, m31, m32, m33 ) } {}
 
-    mat4( const mat4& m )
-	{
-	    if ( *this != m ) {
-		_m[0] = m._m[0];
-		_m[1] = m._m[1];
-		_m[2] = m._m[2];
-		_m[3] = m._m[3];
-	    } 
-	}
+    constexpr mat4( const mat4& m )
+	: _m{ m._m[0], m._m[1], m._m[2], m._m[3] } {}
 
     //
     //  --- Indexing Operator ---
     //
 
     vec4& operator [] ( int i ) { return _m[i]; }
-    const vec4& operator [] ( int i ) const { return _m[i]; }
+    constexpr const vec4& operator [] ( int i ) const { return _m[i]; }
 
     //
     //  --- (non-modifying) Arithematic Operators ---
@@ -558,17 +554,43 @@ class mat4 {
     friend mat4 operator * ( const GLfloat s, const mat4& m )
 	{ return m * s; }
 	
+    //  Row i of the product is _m[i][0]*m[0] + ... + _m[i][3]*m[3], so
+    //  each row is four vec4 multiply-adds.  The AVX version does rows
+    //  0-1 and 2-3 together.
     mat4 operator * ( const mat4& m ) const {
 	mat4  a( 0.0 );
-
+#if defined(ANGEL_SIMD_AVX)
+	const __m256 b0 = _mm256_broadcast_ps( (const __m128*) &m._m[0].x );
+	const __m256 b1 = _mm256_broadcast_ps( (const __m128*) &m._m[1].x );
+	const __m256 b2 = _mm256_broadcast_ps( (const __m128*) &m._m[2].x );
+	const __m256 b3 = _mm256_broadcast_ps( (const __m128*) &m._m[3].x );
+	for ( int i = 0; i < 4; i += 2 ) {
+	    __m256 rows = _mm256_loadu_ps( &_m[i].x );
+	    __m256 r = _mm256_mul_ps( _mm256_shuffle_ps( rows, rows, 0x00 ), b0 );
+	    r = _mm256_add_ps( r, _mm256_mul_ps( _mm256_shuffle_ps( rows, rows, 0x55 ), b1 ) );
+	    r = _mm256_add_ps( r, _mm256_mul_ps( _mm256_shuffle_ps( rows, rows, 0xAA ), b2 ) );
+	    r = _mm256_add_ps( r, _mm256_mul_ps( _mm256_shuffle_ps( rows, rows, 0xFF ), b3 ) );
+	    _mm256_storeu_ps( &a._m[i].x, r );
+	}
+#elif defined(ANGEL_SIMD_SSE)
+	const __m128 b0 = m._m[0].load(), b1 = m._m[1].load();
+	const __m128 b2 = m._m[2].load(), b3 = m._m[3].load();
+	for ( int i = 0; i < 4; ++i ) {
+	    __m128 row = _m[i].load();
+	    __m128 r = _mm_mul_ps( ANGEL_SIMD_SPLAT( row, 0 ), b0 );
+	    r = _mm_add_ps( r, _mm_mul_ps( ANGEL_SIMD_SPLAT( row, 1 ), b1 ) );
+	    r = _mm_add_ps( r, _mm_mul_ps( ANGEL_SIMD_SPLAT( row, 2 ), b2 ) );
+	    r = _mm_add_ps( r, _mm_mul_ps( ANGEL_SIMD_SPLAT( row, 3 ), b3 ) );
+	    _mm_storeu_ps( &a._m[i].x, r );
+	}
+#else
 	for ( int i = 0; i < 4; ++i ) {
 	    for ( int j = 0; j < 4; ++j ) {
-		for ( int k = 0; k < 4; ++k ) {
-		    a[i][j] += _m[i][k] * m[k][j];
-		}
+		a._m[i][j] = _m[i][0] * m._m[0][j] + _m[i][1] * m._m[1][j] +
+			     _m[i][2] * m._m[2][j] + _m[i][3] * m._m[3][j];
 	    }
 	}
-
+#endif
 	return a;
     }
 
@@ -591,19 +613,8 @@ class mat4 {
 	return *this;
     }
 
-    mat4& operator *= ( const mat4& m ) {
-	mat4  a( 0.0 );
-
-	for ( int i = 0; i < 4; ++i ) {
-	    for ( int j = 0; j < 4; ++j ) {
-		for ( int k = 0; k < 4; ++k ) {
-		    a[i][j] += _m[i][k] * m[k][j];
-		}
-	    }
-	}
-
-	return *this = a;
-    }
+    mat4& operator *= ( const mat4& m )
+	{ return *this = *this * m; }
 
     mat4& operator /= ( const GLfloat s ) {
 #ifdef DEBUG
@@ -623,11 +634,22 @@ class mat4 {
     //
 
     vec4 operator * ( const vec4& v ) const {  // m * v
+#ifdef ANGEL_SIMD_SSE
+	// The four row * v products, transposed so their sums add up lane-wise
+	__m128 p = v.load();
+	__m128 r0 = _mm_mul_ps( _m[0].load(), p );
+	__m128 r1 = _mm_mul_ps( _m[1].load(), p );
+	__m128 r2 = _mm_mul_ps( _m[2].load(), p );
+	__m128 r3 = _mm_mul_ps( _m[3].load(), p );
+	_MM_TRANSPOSE4_PS( r0, r1, r2, r3 );
+	return vec4( _mm_add_ps( _mm_add_ps( r0, r1 ), _mm_add_ps( r2, r3 ) ) );
+#else
 	return vec4( _m[0][0]*v.x + _m[0][1]*v.y + _m[0][2]*v.z + _m[0][3]*v.w,
 		     _m[1][0]*v.x + _m[1][1]*v.y + _m[1][2]*v.z + _m[1][3]*v.w,
 		     _m[2][0]*v.x + _m[2][1]*v.y + _m[2][2]*v.z + _m[2][3]*v.w,
 		     _m[3][0]*v.x + _m[3][1]*v.y + _m[3][2]*v.z + _m[3][3]*v.w
 	    );
+#endif
     }
 	
     //
@@ -684,12 +706,353 @@ mat4 transpose( const mat4& A ) {
 //          In particular this is to be used in the function Rotate().
 inline
 mat4 transpose1( const mat4& A ) {
+#ifdef ANGEL_SIMD_SSE
+    __m128 r0 = A[0].load(), r1 = A[1].load(), r2 = A[2].load(), r3 = A[3].load();
+    _MM_TRANSPOSE4_PS( r0, r1, r2, r3 );
+    return mat4( vec4( r0 ), vec4( r1 ), vec4( r2 ), vec4( r3 ) );
+#else
     return mat4( A[0][0], A[0][1], A[0][2], A[0][3],
 		 A[1][0], A[1][1], A[1][2], A[1][3],
 		 A[2][0], A[2][1], A[2][2], A[2][3],
 		 A[3][0], A[3][1], A[3][2], A[3][3] ); //YJC: Important!!
                                                        //     The 16 items must be given in *column order*,
                                                        //     so in this way we get the transpose.
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Structured transforms
+//
+//   RotateX/Y/Z() and Rotate() return an affine, the top three rows of a
+//   matrix whose 4th row is (0, 0, 0, 1).  Translate() returns a
+//   translation and Scale() a scaling.  Each converts to mat4 wherever a
+//   mat4 is expected, but their products with each other and with mat4
+//   skip the known zeros and ones:
+//
+//     translation * translation   translation, 3 adds
+//     scaling * scaling           scaling, 3 multiplies
+//     translation * mat4          12 multiply-adds instead of 64
+//     affine * affine             affine, 36 multiply-adds, no 4th row
+//     mat4 * affine               48 instead of 64
+//
+//   So in Translate(p) * Rotate(...) * rot, or in a chain of model
+//   transforms, only the final product with a full mat4 (camera,
+//   projection) pays for a general matrix product.
+//
+//   A rigid is an affine that also remembers it is s times a rotation
+//   plus a translation.  Its inverse is a transpose (27 flops), its
+//   normal matrix the rotation itself.  A general affine inverts through
+//   its cofactors, about 60 flops, in float and without a 4x4 inverse.
+//   Keep transforms in these types and let them become a mat4 only where
+//   one is uploaded.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class affine {
+
+    vec4  _m[3];   // rows; the 4th row is (0, 0, 0, 1)
+
+   public:
+    constexpr affine()
+	: _m{ vec4( 1.0, 0.0, 0.0, 0.0 ), vec4( 0.0, 1.0, 0.0, 0.0 ),
+	      vec4( 0.0, 0.0, 1.0, 0.0 ) } {}
+
+    constexpr affine( const vec4& a, const vec4& b, const vec4& c )
+	: _m{ a, b, c } {}
+
+    // The top three rows of m, whose 4th row has to be (0, 0, 0, 1)
+    explicit constexpr affine( const mat4& m )
+	: _m{ m[0], m[1], m[2] } {}
+
+    vec4& operator [] ( int i ) { return _m[i]; }
+    constexpr const vec4& operator [] ( int i ) const { return _m[i]; }
+
+    constexpr operator mat4 () const
+	{ return mat4( _m[0], _m[1], _m[2], vec4( 0.0, 0.0, 0.0, 1.0 ) ); }
+};
+
+struct translation {
+
+    vec3  t;
+
+    explicit constexpr translation( const vec3& t ) : t(t) {}
+
+    constexpr operator affine () const {
+	return affine( vec4( 1.0, 0.0, 0.0, t.x ),
+		       vec4( 0.0, 1.0, 0.0, t.y ),
+		       vec4( 0.0, 0.0, 1.0, t.z ) );
+    }
+
+    constexpr operator mat4 () const {
+	return mat4( vec4( 1.0, 0.0, 0.0, t.x ),
+		     vec4( 0.0, 1.0, 0.0, t.y ),
+		     vec4( 0.0, 0.0, 1.0, t.z ),
+		     vec4( 0.0, 0.0, 0.0, 1.0 ) );
+    }
+};
+
+struct scaling {
+
+    vec3  s;
+
+    explicit constexpr scaling( const vec3& s ) : s(s) {}
+
+    constexpr operator affine () const {
+	return affine( vec4( s.x, 0.0, 0.0, 0.0 ),
+		       vec4( 0.0, s.y, 0.0, 0.0 ),
+		       vec4( 0.0, 0.0, s.z, 0.0 ) );
+    }
+
+    constexpr operator mat4 () const {
+	return mat4( vec4( s.x, 0.0, 0.0, 0.0 ),
+		     vec4( 0.0, s.y, 0.0, 0.0 ),
+		     vec4( 0.0, 0.0, s.z, 0.0 ),
+		     vec4( 0.0, 0.0, 0.0, 1.0 ) );
+    }
+};
+
+class rigid : public affine {
+
+    GLfloat  _scale;   // the rows are _scale times a rotation, plus the 4th column
+
+    constexpr rigid( const affine& a, const GLfloat s ) : affine( a ), _scale( s ) {}
+
+   public:
+    constexpr rigid() : affine(), _scale( 1.0 ) {}
+
+    // rotation has to be a pure rotation (RotateX/Y/Z(), Rotate()); its
+    // 4th column is ignored
+    rigid( const affine& rotation, const vec3& t, const GLfloat s = 1.0 )
+	: affine( vec4( s * rotation[0].x, s * rotation[0].y, s * rotation[0].z, t.x ),
+		  vec4( s * rotation[1].x, s * rotation[1].y, s * rotation[1].z, t.y ),
+		  vec4( s * rotation[2].x, s * rotation[2].y, s * rotation[2].z, t.z ) ),
+	  _scale( s ) {}
+
+    constexpr GLfloat scale() const { return _scale; }
+
+    friend rigid operator * ( const rigid& a, const rigid& b );
+    friend rigid operator * ( const translation& t, const rigid& r );
+    friend rigid operator * ( const rigid& r, const translation& t );
+    friend rigid inverse( const rigid& r );
+};
+
+//
+//  --- Products ---
+//
+
+// r.x * a + r.y * b + r.z * c: the 3x3 part of row r times rows a, b, c
+inline
+vec4 combineRows( const vec4& r, const vec4& a, const vec4& b, const vec4& c )
+{
+    return a * r.x + b * r.y + c * r.z;
+}
+
+// Adds s to the 4th component of r
+inline
+vec4 addW( const vec4& r, const GLfloat s )
+{
+    return r + vec4( 0.0, 0.0, 0.0, s );
+}
+
+inline
+affine operator * ( const affine& a, const affine& b ) {
+    return affine( addW( combineRows( a[0], b[0], b[1], b[2] ), a[0].w ),
+		   addW( combineRows( a[1], b[0], b[1], b[2] ), a[1].w ),
+		   addW( combineRows( a[2], b[0], b[1], b[2] ), a[2].w ) );
+}
+
+inline
+mat4 operator * ( const affine& a, const mat4& m ) {
+    return mat4( combineRows( a[0], m[0], m[1], m[2] ) + m[3] * a[0].w,
+		 combineRows( a[1], m[0], m[1], m[2] ) + m[3] * a[1].w,
+		 combineRows( a[2], m[0], m[1], m[2] ) + m[3] * a[2].w,
+		 m[3] );
+}
+
+inline
+mat4 operator * ( const mat4& m, const affine& a ) {
+    return mat4( addW( combineRows( m[0], a[0], a[1], a[2] ), m[0].w ),
+		 addW( combineRows( m[1], a[0], a[1], a[2] ), m[1].w ),
+		 addW( combineRows( m[2], a[0], a[1], a[2] ), m[2].w ),
+		 addW( combineRows( m[3], a[0], a[1], a[2] ), m[3].w ) );
+}
+
+inline
+vec4 operator * ( const affine& a, const vec4& v ) {
+    return vec4( dot( a[0], v ), dot( a[1], v ), dot( a[2], v ), v.w );
+}
+
+// A translation moves the 4th column: T * A adds t to it, A * T adds A * t
+
+inline constexpr
+translation operator * ( const translation& a, const translation& b ) {
+    return translation( a.t + b.t );
+}
+
+inline
+affine operator * ( const translation& t, const affine& a ) {
+    return affine( addW( a[0], t.t.x ), addW( a[1], t.t.y ), addW( a[2], t.t.z ) );
+}
+
+inline
+affine operator * ( const affine& a, const translation& t ) {
+    const vec4 p( t.t, 0.0 );
+    return affine( addW( a[0], dot( a[0], p ) ),
+		   addW( a[1], dot( a[1], p ) ),
+		   addW( a[2], dot( a[2], p ) ) );
+}
+
+inline
+mat4 operator * ( const translation& t, const mat4& m ) {
+    return mat4( m[0] + m[3] * t.t.x, m[1] + m[3] * t.t.y, m[2] + m[3] * t.t.z, m[3] );
+}
+
+inline
+mat4 operator * ( const mat4& m, const translation& t ) {
+    const vec4 p( t.t, 0.0 );
+    return mat4( addW( m[0], dot( m[0], p ) ), addW( m[1], dot( m[1], p ) ),
+		 addW( m[2], dot( m[2], p ) ), addW( m[3], dot( m[3], p ) ) );
+}
+
+inline
+vec4 operator * ( const translation& t, const vec4& v ) {
+    return v + vec4( t.t * v.w, 0.0 );
+}
+
+// A scaling scales rows from the left and the 3x3 columns from the right
+
+inline constexpr
+scaling operator * ( const scaling& a, const scaling& b ) {
+    return scaling( a.s * b.s );
+}
+
+inline
+affine operator * ( const scaling& s, const affine& a ) {
+    return affine( a[0] * s.s.x, a[1] * s.s.y, a[2] * s.s.z );
+}
+
+inline
+affine operator * ( const affine& a, const scaling& s ) {
+    const vec4 c( s.s, 1.0 );
+    return affine( a[0] * c, a[1] * c, a[2] * c );
+}
+
+inline
+mat4 operator * ( const scaling& s, const mat4& m ) {
+    return mat4( m[0] * s.s.x, m[1] * s.s.y, m[2] * s.s.z, m[3] );
+}
+
+inline
+mat4 operator * ( const mat4& m, const scaling& s ) {
+    const vec4 c( s.s, 1.0 );
+    return mat4( m[0] * c, m[1] * c, m[2] * c, m[3] * c );
+}
+
+inline
+vec4 operator * ( const scaling& s, const vec4& v ) {
+    return v * vec4( s.s, 1.0 );
+}
+
+// Mixed translation / scaling
+
+inline constexpr
+affine operator * ( const translation& t, const scaling& s ) {
+    return affine( vec4( s.s.x, 0.0, 0.0, t.t.x ),
+		   vec4( 0.0, s.s.y, 0.0, t.t.y ),
+		   vec4( 0.0, 0.0, s.s.z, t.t.z ) );
+}
+
+inline constexpr
+affine operator * ( const scaling& s, const translation& t ) {
+    return affine( vec4( s.s.x, 0.0, 0.0, s.s.x * t.t.x ),
+		   vec4( 0.0, s.s.y, 0.0, s.s.y * t.t.y ),
+		   vec4( 0.0, 0.0, s.s.z, s.s.z * t.t.z ) );
+}
+
+// rigid stays rigid under products with itself and with translations;
+// everything else goes through the affine products
+
+inline
+rigid operator * ( const rigid& a, const rigid& b ) {
+    return rigid( static_cast<const affine&>( a ) * b, a._scale * b._scale );
+}
+
+inline
+rigid operator * ( const translation& t, const rigid& r ) {
+    return rigid( t * static_cast<const affine&>( r ), r._scale );
+}
+
+inline
+rigid operator * ( const rigid& r, const translation& t ) {
+    return rigid( static_cast<const affine&>( r ) * t, r._scale );
+}
+
+//
+//  --- Inverses and normal matrices ---
+//
+
+inline constexpr
+translation inverse( const translation& t ) {
+    return translation( -t.t );
+}
+
+inline constexpr
+scaling inverse( const scaling& s ) {
+    return scaling( vec3( 1.0 / s.s.x, 1.0 / s.s.y, 1.0 / s.s.z ) );
+}
+
+// (s R | t)^-1 = (R^T / s | -R^T t / s), and R^T / s is the transposed
+// rows divided by s^2
+inline
+rigid inverse( const rigid& r ) {
+    const GLfloat k = 1.0 / (r._scale * r._scale);
+    const vec4 a = vec4( r[0].x, r[1].x, r[2].x, 0.0 ) * k;
+    const vec4 b = vec4( r[0].y, r[1].y, r[2].y, 0.0 ) * k;
+    const vec4 c = vec4( r[0].z, r[1].z, r[2].z, 0.0 ) * k;
+    const vec4 t( r[0].w, r[1].w, r[2].w, 0.0 );
+    return rigid( affine( addW( a, -dot( a, t ) ), addW( b, -dot( b, t ) ),
+			  addW( c, -dot( c, t ) ) ), 1.0 / r._scale );
+}
+
+// The 3x3 part of m inverts as its cofactors over the determinant; the
+// cofactor rows are the cross products of pairs of rows.  m has to be
+// invertible, a singular m gives non-finite entries.
+inline
+affine inverse( const affine& m ) {
+    const vec3 c0 = cross( m[1], m[2] );
+    const vec3 c1 = cross( m[2], m[0] );
+    const vec3 c2 = cross( m[0], m[1] );
+    const GLfloat k = 1.0 / dot( vec3( m[0].x, m[0].y, m[0].z ), c0 );
+    const vec4 a = vec4( c0.x, c1.x, c2.x, 0.0 ) * k;
+    const vec4 b = vec4( c0.y, c1.y, c2.y, 0.0 ) * k;
+    const vec4 c = vec4( c0.z, c1.z, c2.z, 0.0 ) * k;
+    const vec4 t( m[0].w, m[1].w, m[2].w, 0.0 );
+    return affine( addW( a, -dot( a, t ) ), addW( b, -dot( b, t ) ),
+		   addW( c, -dot( c, t ) ) );
+}
+
+// transpose1(inverse(s R)) is R / s.  The 1 / s only changes lengths,
+// so the rotation R is returned instead: normals stay unit length
+inline
+mat3 NormalMatrix( const rigid& r ) {
+    const GLfloat k = 1.0 / r.scale();
+    return mat3( vec3( r[0].x, r[0].y, r[0].z ) * k,
+		 vec3( r[1].x, r[1].y, r[1].z ) * k,
+		 vec3( r[2].x, r[2].y, r[2].z ) * k );
+}
+
+// transpose1(inverse(m)) for the 3x3 part: the cofactor rows over the
+// determinant.  Where m is singular and that does not exist, the
+// cofactors alone still point the surviving normals the right way.
+inline
+mat3 NormalMatrix( const affine& m ) {
+    const vec3 c0 = cross( m[1], m[2] );
+    const vec3 c1 = cross( m[2], m[0] );
+    const vec3 c2 = cross( m[0], m[1] );
+    const GLfloat det = dot( vec3( m[0].x, m[0].y, m[0].z ), c0 );
+    const GLfloat k = det != 0.0 ? 1.0 / det : 1.0;
+    return mat3( c0 * k, c1 * k, c2 * k );
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -721,11 +1084,11 @@ vec4 mvmult( const mat4& a, const vec4& b )
 //
 
 inline
-mat4 RotateX( const GLfloat theta )
+affine RotateX( const GLfloat theta )
 {
     GLfloat angle = DegreesToRadians * theta;
 
-    mat4 c;
+    affine c;
     c[2][2] = c[1][1] = cos(angle);
     c[2][1] = sin(angle);
     c[1][2] = -c[2][1];
@@ -733,11 +1096,11 @@ mat4 RotateX( const GLfloat theta )
 }
 
 inline
-mat4 RotateY( const GLfloat theta )
+affine RotateY( const GLfloat theta )
 {
     GLfloat angle = DegreesToRadians * theta;
 
-    mat4 c;
+    affine c;
     c[2][2] = c[0][0] = cos(angle);
     c[0][2] = sin(angle);
     c[2][0] = -c[0][2];
@@ -745,11 +1108,11 @@ mat4 RotateY( const GLfloat theta )
 }
 
 inline
-mat4 RotateZ( const GLfloat theta )
+affine RotateZ( const GLfloat theta )
 {
     GLfloat angle = DegreesToRadians * theta;
 
-    mat4 c;
+    affine c;
     c[0][0] = c[1][1] = cos(angle);
     c[1][0] = sin(angle);
     c[0][1] = -c[1][0];
@@ -761,10 +1124,8 @@ mat4 RotateZ( const GLfloat theta )
           Note: The rotation axis vector (x, y, z) can have length != 1.0.
 */
 inline
-mat4 Rotate(const GLfloat angle, const GLfloat x, const GLfloat y, const GLfloat z)
+affine Rotate(const GLfloat angle, const GLfloat x, const GLfloat y, const GLfloat z)
 {
-    mat4 result;
-
     //YJC: normalize (x, y, z) to a unit-length vector (x1, y1, z1) and use the latter.
     float len = sqrt(x * x + y * y + z * z);
     float x1, y1, z1;
@@ -784,44 +1145,154 @@ mat4 Rotate(const GLfloat angle, const GLfloat x, const GLfloat y, const GLfloat
     const float s = sinf(rads);
     const float omc = 1.0f - c;
 
-    result[0] = vec4(x2 * omc + c, y1 * x1 * omc + z1 * s, x1 * z1 * omc - y1 * s, 0.0);
-    result[1] = vec4(x1 * y1 * omc - z1 * s, y2 * omc + c, y1 * z1 * omc + x1 * s, 0.0);
-    result[2] = vec4(x1 * z1 * omc + y1 * s, y1 * z1 * omc - x1 * s, z2 * omc + c, 0.0);
-    result[3] = vec4(0.0, 0.0, 0.0, 1.0);
-
-    /*** YJC: compared with "glMatrixEA.js-YJC" mat4.rotate, the matrix "result" above is the same
+    /*** YJC: compared with "glMatrixEA.js-YJC" mat4.rotate, that matrix is the same
               and is in *Column Order* ("vmath.h" file also indicates this, saying that the matrix
               is "Column primary data (essentially, array of vectors)").
-         ===> Return transpose1(result) to make it *Row Order*, to be consistent with other functions here.
-              (Note: we use transpose1() instead of transpose(); the latter is incorrect.)
+         ===> The rows below are its transpose, i.e. *Row Order*, to be consistent with other
+              functions here, without building the mat4 and calling transpose1().
     ***/
-    return transpose1(result); 
-    // return result;  /* Original */
+    return affine( vec4(x2 * omc + c, x1 * y1 * omc - z1 * s, x1 * z1 * omc + y1 * s, 0.0),
+		   vec4(y1 * x1 * omc + z1 * s, y2 * omc + c, y1 * z1 * omc - x1 * s, 0.0),
+		   vec4(x1 * z1 * omc - y1 * s, y1 * z1 * omc + x1 * s, z2 * omc + c, 0.0) );
 }
 
 //----------------------------------------------------------------------------
 //
-//  Translation matrix generators
+//  quat - unit quaternion
+//
+//   (x, y, z) is sin(angle/2) times the unit axis and w is cos(angle/2).
+//   q * r rotates by r first, then by q, the same order as the matrices.
+//   A product is 16 multiplies against 27 for the 3x3 part of an affine,
+//   and normalize() keeps a long chain of products an exact rotation,
+//   where accumulated matrices slowly stop being orthogonal.  Rotate(q)
+//   turns one into an affine when a matrix is needed.
 //
 
+struct quat {
+
+    GLfloat  x, y, z, w;
+
+    constexpr quat() : x(0.0), y(0.0), z(0.0), w(1.0) {}
+
+    constexpr quat( GLfloat x, GLfloat y, GLfloat z, GLfloat w )
+	: x(x), y(y), z(z), w(w) {}
+
+    constexpr quat operator - () const
+	{ return quat( -x, -y, -z, -w ); }
+};
+
+inline constexpr
+quat operator * ( const quat& a, const quat& b ) {
+    return quat( a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+		 a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+		 a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+		 a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z );
+}
+
+inline constexpr
+GLfloat dot( const quat& a, const quat& b ) {
+    return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+}
+
+// The inverse of a unit quaternion
+inline constexpr
+quat conjugate( const quat& q ) {
+    return quat( -q.x, -q.y, -q.z, q.w );
+}
+
 inline
-mat4 Translate( const GLfloat x, const GLfloat y, const GLfloat z )
+quat normalize( const quat& q ) {
+    const GLfloat k = 1.0 / sqrt( dot( q, q ) );
+    return quat( q.x * k, q.y * k, q.z * k, q.w * k );
+}
+
+// Same arguments as Rotate(): angle in degrees, (x, y, z) of any length.
+// A zero axis gives no rotation.
+inline
+quat RotateQuat( const GLfloat angle, const GLfloat x, const GLfloat y, const GLfloat z )
 {
-    mat4 c;
-    c[0][3] = x;
-    c[1][3] = y;
-    c[2][3] = z;
-    return c;
+    const GLfloat len = sqrt( x * x + y * y + z * z );
+    if ( len == 0.0 ) { return quat(); }
+
+    const GLfloat half = 0.5 * DegreesToRadians * angle;
+    const GLfloat k = sinf( half ) / len;
+    return quat( x * k, y * k, z * k, cosf( half ) );
 }
 
+// q applied t times: the same axis, t times the angle.  For integer t
+// this is q * q * ... * q without the t - 1 products.
 inline
-mat4 Translate( const vec3& v )
+quat pow( const quat& q, const GLfloat t )
 {
-    return Translate( v.x, v.y, v.z );
+    const GLfloat s = sqrt( q.x * q.x + q.y * q.y + q.z * q.z );
+    if ( s < 1e-7 ) { return quat(); }  // no rotation, no axis
+
+    const GLfloat half = t * atan2f( s, q.w );
+    const GLfloat k = sinf( half ) / s;
+    return quat( q.x * k, q.y * k, q.z * k, cosf( half ) );
+}
+
+// The shorter way from a (t = 0) to b (t = 1) at constant angular speed
+inline
+quat slerp( const quat& a, const quat& b, const GLfloat t )
+{
+    GLfloat c = dot( a, b );
+    const quat e = c < 0.0 ? -b : b;
+    if ( c < 0.0 ) { c = -c; }
+
+    GLfloat wa = 1.0 - t, wb = t;
+    if ( c < 0.9995 ) {  // else nearly parallel: lerp, normalized below
+	const GLfloat theta = acosf( c );
+	const GLfloat k = 1.0 / sinf( theta );
+	wa = sinf( wa * theta ) * k;
+	wb = sinf( wb * theta ) * k;
+    }
+    return normalize( quat( a.x * wa + e.x * wb, a.y * wa + e.y * wb,
+			    a.z * wa + e.z * wb, a.w * wa + e.w * wb ) );
 }
 
+// v rotated by the unit quaternion q
 inline
-mat4 Translate( const vec4& v )
+vec3 operator * ( const quat& q, const vec3& v ) {
+    const vec3 u( q.x, q.y, q.z );
+    const vec3 t = cross( u, v ) * 2.0;
+    return v + t * q.w + cross( u, t );
+}
+
+// The rotation of the unit quaternion q, the same affine that Rotate()
+// gives for the angle and axis q was made from
+inline
+affine Rotate( const quat& q )
+{
+    const GLfloat x2 = q.x + q.x, y2 = q.y + q.y, z2 = q.z + q.z;
+    const GLfloat xx = q.x * x2, yy = q.y * y2, zz = q.z * z2;
+    const GLfloat xy = q.x * y2, xz = q.x * z2, yz = q.y * z2;
+    const GLfloat wx = q.w * x2, wy = q.w * y2, wz = q.w * z2;
+
+    return affine( vec4( 1.0 - yy - zz, xy - wz, xz + wy, 0.0 ),
+		   vec4( xy + wz, 1.0 - xx - zz, yz - wx, 0.0 ),
+		   vec4( xz - wy, yz + wx, 1.0 - xx - yy, 0.0 ) );
+}
+
+//----------------------------------------------------------------------------
+//
+//  Translation matrix generators
+//
+
+inline constexpr
+translation Translate( const GLfloat x, const GLfloat y, const GLfloat z )
+{
+    return translation( vec3( x, y, z ) );
+}
+
+inline constexpr
+translation Translate( const vec3& v )
+{
+    return translation( v );
+}
+
+inline constexpr
+translation Translate( const vec4& v )
 {
     return Translate( v.x, v.y, v.z );
 }
@@ -831,20 +1302,16 @@ mat4 Translate( const vec4& v )
 //  Scale matrix generators
 //
 
-inline
-mat4 Scale( const GLfloat x, const GLfloat y, const GLfloat z )
+inline constexpr
+scaling Scale( const GLfloat x, const GLfloat y, const GLfloat z )
 {
-    mat4 c;
-    c[0][0] = x;
-    c[1][1] = y;
-    c[2][2] = z;
-    return c;
+    return scaling( vec3( x, y, z ) );
 }
 
-inline
-mat4 Scale( const vec3& v )
+inline constexpr
+scaling Scale( const vec3& v )
 {
-    return Scale( v.x, v.y, v.z );
+    return scaling( v );
 }
 
 //----------------------------------------------------------------------------
@@ -858,23 +1325,18 @@ mat4 Scale( const vec3& v )
 
 
 
-inline
+inline constexpr
 mat4 Ortho( const GLfloat left, const GLfloat right,
 	    const GLfloat bottom, const GLfloat top,
 	    const GLfloat zNear, const GLfloat zFar )
 {
-    mat4 c;
-    c[0][0] = 2.0/(right - left);
-    c[1][1] = 2.0/(top - bottom);
-    c[2][2] = 2.0/(zNear - zFar);
-    c[3][3] = 1.0;
-    c[0][3] = -(right + left)/(right - left);
-    c[1][3] = -(top + bottom)/(top - bottom);
-    c[2][3] = -(zFar + zNear)/(zFar - zNear);
-    return c;
+    return mat4( vec4( 2.0/(right - left), 0.0, 0.0, -(right + left)/(right - left) ),
+		 vec4( 0.0, 2.0/(top - bottom), 0.0, -(top + bottom)/(top - bottom) ),
+		 vec4( 0.0, 0.0, 2.0/(zNear - zFar), -(zFar + zNear)/(zFar - zNear) ),
+		 vec4( 0.0, 0.0, 0.0, 1.0 ) );
 }
 
-inline
+inline constexpr
 mat4 Ortho2D( const GLfloat left, const GLfloat right,
 	      const GLfloat bottom, const GLfloat top )
 {
@@ -919,7 +1381,7 @@ mat4 Perspective( const GLfloat fovy, const GLfloat aspect,
 //
 
 inline
-mat4 LookAt( const vec4& eye, const vec4& at, const vec4& up )
+rigid LookAt( const vec4& eye, const vec4& at, const vec4& up )
 {
     vec4 n = normalize(eye - at);
 
@@ -933,9 +1395,7 @@ mat4 LookAt( const vec4& eye, const vec4& at, const vec4& up )
     // vec4 u = normalize( cross(up,n) );
     // vec4 v = normalize( cross(n,u)  );
     
-    vec4 t = vec4(0.0, 0.0, 0.0, 1.0);
-    mat4 c = mat4(u, v, n, t);
-    return c * Translate( -eye );
+    return rigid( affine(u, v, n), vec3(0.0) ) * Translate( -eye );
 }
 
 //---------------------------------------------------------------------------
@@ -966,7 +1426,7 @@ mat3 NormalMatrix( const mat4& mv, int non_uniform_scale_flag ) {
     return m;
 
   else // mv involves non-uniform scaling ==> return the transpose of inverse(m)
-    return transpose1( inverse(m) );
+    return NormalMatrix( affine(mv) );  // closed form, no exit on singular mv
 }
 
 // YJC: Added the following:
@@ -1003,7 +1463,7 @@ void printv(const vec4& a )
 }
 
 inline
-void printm(const mat4 a)
+void printm(const mat4& a)
 {
     Error( "replace with matrix insertion operator" );
     for(int i=0; i<4; i++) printf("%f %f %f %f \n", a[i][0], a[i][1], a[i][2], a[i][3]);
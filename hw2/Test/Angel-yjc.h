@@ -55,6 +55,14 @@ namespace Angel {
 GLuint InitShader( const char* vertexShaderFile,
 		   const char* fragmentShaderFile );
 
+//  Same as InitShader(), split so compiling overlaps other startup work:
+//  SubmitShader() queues the program, FinishShader() checks it at first
+//  use and returns 0 if it failed to build.
+GLuint SubmitShader( const char* vertexShaderFile,
+		     const char* fragmentShaderFile );
+bool   ShaderReady( GLuint program );
+GLuint FinishShader( GLuint program );
+
 //  Defined constant for when numbers are too small to be used in the
 //    denominator of a division operation.  This is only used if the
 //    DEBUG macro is defined.
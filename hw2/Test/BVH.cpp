@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <functional>
+#include <math.h>
+#include "BVH.h"
+
+void
+BVH::build(const std::vector<vec3>& lo, const std::vector<vec3>& hi)
+{
+    int n = int(lo.size());
+    _nodes.clear();
+    _items.resize( n );
+    _leaf.resize( n );
+    _centers.resize( n );
+    for ( int i = 0; i < n; ++i ) {
+	_items[i] = i;
+	_centers[i] = (lo[i] + hi[i]) * 0.5;
+    }
+    _nodes.reserve( 2 * (n / LeafSize + 1) );
+    if ( n > 0 ) { build( -1, 0, n, lo, hi ); }
+    _marked.assign( _nodes.size(), 0 );
+
+    _area = 0.0;
+    for ( size_t i = 0; i < _nodes.size(); ++i ) _area += area( _nodes[i] );
+    _builtArea = _area;
+}
+
+int
+BVH::build(int parent, int first, int count,
+	   const std::vector<vec3>& lo, const std::vector<vec3>& hi)
+{
+    int n = int(_nodes.size());
+    _nodes.push_back( Node() );
+    _nodes[n].first = first;
+    _nodes[n].count = count;
+    _nodes[n].right = 0;
+    _nodes[n].parent = parent;
+
+    if ( count <= LeafSize ) {
+	for ( int i = first; i < first + count; ++i ) _leaf[_items[i]] = n;
+    }
+    else {
+	// Median of the centers along their longest axis
+	vec3 cLo( 1e30f ), cHi( -1e30f );
+	for ( int i = first; i < first + count; ++i ) {
+	    const vec3& c = _centers[_items[i]];
+	    for ( int k = 0; k < 3; ++k ) {
+		cLo[k] = fminf( cLo[k], c[k] );
+		cHi[k] = fmaxf( cHi[k], c[k] );
+	    }
+	}
+	vec3 size = cHi - cLo;
+	int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+	int half = count / 2;
+	const std::vector<vec3>& centers = _centers;
+	std::nth_element( _items.begin() + first, _items.begin() + first + half,
+			  _items.begin() + first + count,
+			  [&centers, axis]( int a, int b ) { return centers[a][axis] < centers[b][axis]; } );
+
+	build( n, first, half, lo, hi );
+	int right = build( n, first + half, count - half, lo, hi );
+	_nodes[n].right = right;   // _nodes may have moved: index, not reference
+    }
+    fit( n, lo, hi );
+    return n;
+}
+
+void
+BVH::fit(int n, const std::vector<vec3>& lo, const std::vector<vec3>& hi)
+{
+    Node& node = _nodes[n];
+    if ( node.right == 0 ) {
+	node.lo = vec3( 1e30f );
+	node.hi = vec3( -1e30f );
+	for ( int i = node.first; i < node.first + node.count; ++i ) {
+	    int item = _items[i];
+	    for ( int k = 0; k < 3; ++k ) {
+		node.lo[k] = fminf( node.lo[k], lo[item][k] );
+		node.hi[k] = fmaxf( node.hi[k], hi[item][k] );
+	    }
+	}
+	return;
+    }
+    const Node &a = _nodes[n + 1], &b = _nodes[node.right];
+    for ( int k = 0; k < 3; ++k ) {
+	node.lo[k] = fminf( a.lo[k], b.lo[k] );
+	node.hi[k] = fmaxf( a.hi[k], b.hi[k] );
+    }
+}
+
+double
+BVH::area(const Node& n)
+{
+    // Doubles: unbounded items have boxes of +-1e30
+    double x = double(n.hi.x) - n.lo.x, y = double(n.hi.y) - n.lo.y, z = double(n.hi.z) - n.lo.z;
+    return 2.0 * (x * y + y * z + z * x);
+}
+
+void
+BVH::refit(const std::vector<int>& moved,
+	   const std::vector<vec3>& lo, const std::vector<vec3>& hi)
+{
+    // The moved items' leaves and all their ancestors, each once
+    _dirty.clear();
+    for ( size_t i = 0; i < moved.size(); ++i ) {
+	for ( int n = _leaf[moved[i]]; n >= 0 && !_marked[n]; n = _nodes[n].parent ) {
+	    _marked[n] = 1;
+	    _dirty.push_back( n );
+	}
+    }
+
+    // Children come after their parents, so fit from the last node back
+    std::sort( _dirty.begin(), _dirty.end(), std::greater<int>() );
+    for ( size_t i = 0; i < _dirty.size(); ++i ) {
+	int n = _dirty[i];
+	_area -= area( _nodes[n] );
+	fit( n, lo, hi );
+	_area += area( _nodes[n] );
+	_marked[n] = 0;
+    }
+}
+
+void
+BVH::cull(const ViewFrustum& f, const std::vector<vec3>& lo, const std::vector<vec3>& hi,
+	  std::vector<int>& visible) const
+{
+    if ( _nodes.empty() ) { return; }
+
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while ( top > 0 ) {
+	const Node& node = _nodes[stack[--top]];
+	ViewFrustum::Result r = f.testBox( node.lo, node.hi );
+	if ( r == ViewFrustum::Outside ) { continue; }
+
+	if ( r == ViewFrustum::Inside ) {
+	    visible.insert( visible.end(), _items.begin() + node.first,
+			    _items.begin() + node.first + node.count );
+	    continue;
+	}
+	if ( node.right == 0 ) {
+	    // A leaf on the edge: its items one by one
+	    for ( int i = node.first; i < node.first + node.count; ++i ) {
+		int item = _items[i];
+		if ( f.testBox( lo[item], hi[item] ) != ViewFrustum::Outside )
+		    visible.push_back( item );
+	    }
+	    continue;
+	}
+	stack[top++] = node.right;
+	stack[top++] = int(&node - &_nodes[0]) + 1;
+    }
+}
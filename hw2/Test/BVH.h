@@ -0,0 +1,72 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- BVH.h ---
+//
+//   Bounding volume hierarchy over a set of boxes (the scene's entities),
+//   for frustum culling.  build() splits the items at the median of the
+//   longest axis of their centers until at most LeafSize are left.  Nodes
+//   are stored depth first, so a node's items are one contiguous range
+//   of items() and its children come after it: cull() takes a node that
+//   is wholly inside the frustum as one range, without visiting it.
+//
+//   Moving items does not need a new tree: refit() recomputes the boxes
+//   of their leaves and of those leaves' ancestors only.  Refitting keeps
+//   the tree correct but not good, as items drift away from their
+//   neighbours; needsRebuild() says when the boxes have grown enough
+//   (their total surface area doubled) to build again.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __BVH_H__
+#define __BVH_H__
+
+#include <vector>
+#include "Angel-yjc.h"
+#include "ViewFrustum.h"
+
+class BVH {
+   public:
+    enum { LeafSize = 4 };
+
+    BVH() : _builtArea(0.0), _area(0.0) {}
+
+    // A tree over items 0..lo.size()-1 with boxes lo[i]..hi[i]
+    void build( const std::vector<vec3>& lo, const std::vector<vec3>& hi );
+
+    // New boxes for the "moved" items
+    void refit( const std::vector<int>& moved,
+		const std::vector<vec3>& lo, const std::vector<vec3>& hi );
+
+    bool needsRebuild() const { return _area > 2.0 * _builtArea; }
+
+    // Items in the tree
+    int size() const { return int(_items.size()); }
+
+    // Append every item whose box (as of the last build() or refit()) is
+    // not outside f to "visible"
+    void cull( const ViewFrustum& f, const std::vector<vec3>& lo, const std::vector<vec3>& hi,
+	       std::vector<int>& visible ) const;
+
+   private:
+    struct Node {
+	vec3 lo, hi;
+	int  first, count;   // range of _items
+	int  right;          // second child, the first is the next node; 0: leaf
+	int  parent;         // -1: root
+    };
+
+    int  build( int parent, int first, int count,
+		const std::vector<vec3>& lo, const std::vector<vec3>& hi );
+    void fit( int n, const std::vector<vec3>& lo, const std::vector<vec3>& hi );
+    static double area( const Node& n );
+
+    std::vector<Node> _nodes;
+    std::vector<int>  _items;     // item indices, in leaf order
+    std::vector<int>  _leaf;      // node holding each item
+    std::vector<int>  _dirty;     // refit(): nodes to fit, scratch
+    std::vector<char> _marked;    // refit(): whether in _dirty
+    std::vector<vec3> _centers;   // build(): scratch
+    double            _builtArea, _area;   // sum over the nodes
+};
+
+#endif // __BVH_H__
@@ -0,0 +1,160 @@
+#include <float.h>
+#include <math.h>
+#include "Batch.h"
+#include "JobSystem.h"
+
+// Width of one SIMD step; chunks handed to threads are multiples of it
+#if defined(ANGEL_SIMD_AVX)
+static const size_t Lanes = 8;
+#elif defined(ANGEL_SIMD_SSE)
+static const size_t Lanes = 4;
+#else
+static const size_t Lanes = 1;
+#endif
+
+static const unsigned MaxChunks = 64;
+
+// Run f(begin, end, chunk) over [0, n) on the job system, about one chunk
+// per thread, when n is large enough to pay for handing it out.  Returns
+// the number of chunks (at most MaxChunks).
+template <class F>
+static unsigned
+parallelFor(size_t n, F f)
+{
+    unsigned threads = jobSystem.threads();
+    if ( n < BatchParallelMin || threads < 2 ) {
+	f( 0, n, 0 );
+	return 1;
+    }
+    if ( threads > MaxChunks ) { threads = MaxChunks; }
+
+    size_t step = (n + threads - 1) / threads;
+    step = (step + Lanes - 1) / Lanes * Lanes;
+    return jobSystem.parallelFor( n, step, f );
+}
+
+//----------------------------------------------------------------------------
+//
+//  SIMD helpers.  The loops below leave the remainder to the scalar tail.
+//
+
+#if defined(ANGEL_SIMD_AVX)
+#  define BATCH_STEP 8
+typedef __m256 Reg;
+static inline Reg vsplat( float f )               { return _mm256_set1_ps( f ); }
+static inline Reg vload( const float* p )         { return _mm256_loadu_ps( p ); }
+static inline void vstore( float* p, Reg r )      { _mm256_storeu_ps( p, r ); }
+static inline Reg vadd( Reg a, Reg b )            { return _mm256_add_ps( a, b ); }
+static inline Reg vmul( Reg a, Reg b )            { return _mm256_mul_ps( a, b ); }
+static inline Reg vmin( Reg a, Reg b )            { return _mm256_min_ps( a, b ); }
+static inline Reg vmax( Reg a, Reg b )            { return _mm256_max_ps( a, b ); }
+#elif defined(ANGEL_SIMD_SSE)
+#  define BATCH_STEP 4
+typedef __m128 Reg;
+static inline Reg vsplat( float f )               { return _mm_set1_ps( f ); }
+static inline Reg vload( const float* p )         { return _mm_loadu_ps( p ); }
+static inline void vstore( float* p, Reg r )      { _mm_storeu_ps( p, r ); }
+static inline Reg vadd( Reg a, Reg b )            { return _mm_add_ps( a, b ); }
+static inline Reg vmul( Reg a, Reg b )            { return _mm_mul_ps( a, b ); }
+static inline Reg vmin( Reg a, Reg b )            { return _mm_min_ps( a, b ); }
+static inline Reg vmax( Reg a, Reg b )            { return _mm_max_ps( a, b ); }
+#endif
+
+//----------------------------------------------------------------------------
+
+static void
+boundsRange(const Points& p, size_t begin, size_t end, vec3& lo, vec3& hi)
+{
+    const float *x = &p.x[0], *y = &p.y[0], *z = &p.z[0];
+    lo = vec3( FLT_MAX );
+    hi = vec3( -FLT_MAX );
+    size_t i = begin;
+
+#ifdef BATCH_STEP
+    if ( i + BATCH_STEP <= end ) {
+	Reg lx = vload( x + i ), ly = vload( y + i ), lz = vload( z + i );
+	Reg hx = lx, hy = ly, hz = lz;
+	for ( i += BATCH_STEP; i + BATCH_STEP <= end; i += BATCH_STEP ) {
+	    Reg px = vload( x + i ), py = vload( y + i ), pz = vload( z + i );
+	    lx = vmin( lx, px );  ly = vmin( ly, py );  lz = vmin( lz, pz );
+	    hx = vmax( hx, px );  hy = vmax( hy, py );  hz = vmax( hz, pz );
+	}
+	float l[3][BATCH_STEP], h[3][BATCH_STEP];
+	vstore( l[0], lx );  vstore( l[1], ly );  vstore( l[2], lz );
+	vstore( h[0], hx );  vstore( h[1], hy );  vstore( h[2], hz );
+	for ( int k = 0; k < BATCH_STEP; ++k ) {
+	    for ( int c = 0; c < 3; ++c ) {
+		lo[c] = fminf( lo[c], l[c][k] );
+		hi[c] = fmaxf( hi[c], h[c][k] );
+	    }
+	}
+    }
+#endif
+
+    for ( ; i < end; ++i ) {
+	lo.x = fminf( lo.x, x[i] );  hi.x = fmaxf( hi.x, x[i] );
+	lo.y = fminf( lo.y, y[i] );  hi.y = fmaxf( hi.y, y[i] );
+	lo.z = fminf( lo.z, z[i] );  hi.z = fmaxf( hi.z, z[i] );
+    }
+}
+
+void
+computeAABB(const Points& p, vec3& lo, vec3& hi)
+{
+    lo = vec3( FLT_MAX );
+    hi = vec3( -FLT_MAX );
+    if ( p.size() == 0 ) { return; }
+
+    // One partial box per chunk, merged afterwards
+    vec3 partLo[MaxChunks], partHi[MaxChunks];
+    unsigned chunks = parallelFor( p.size(), [&]( size_t b, size_t e, unsigned c ) {
+	boundsRange( p, b, e, partLo[c], partHi[c] );
+    } );
+    for ( unsigned c = 0; c < chunks; ++c ) {
+	for ( int k = 0; k < 3; ++k ) {
+	    lo[k] = fminf( lo[k], partLo[c][k] );
+	    hi[k] = fmaxf( hi[k], partHi[c][k] );
+	}
+    }
+}
+
+//----------------------------------------------------------------------------
+
+static float
+radiusRange(const Points& p, size_t begin, size_t end)
+{
+    const float *x = &p.x[0], *y = &p.y[0], *z = &p.z[0];
+    float r2 = 0.0f;
+    size_t i = begin;
+
+#ifdef BATCH_STEP
+    if ( i + BATCH_STEP <= end ) {
+	Reg m = vsplat( 0.0f );
+	for ( ; i + BATCH_STEP <= end; i += BATCH_STEP ) {
+	    Reg px = vload( x + i ), py = vload( y + i ), pz = vload( z + i );
+	    m = vmax( m, vadd( vadd( vmul( px, px ), vmul( py, py ) ), vmul( pz, pz ) ) );
+	}
+	float l[BATCH_STEP];
+	vstore( l, m );
+	for ( int k = 0; k < BATCH_STEP; ++k ) r2 = fmaxf( r2, l[k] );
+    }
+#endif
+
+    for ( ; i < end; ++i )
+	r2 = fmaxf( r2, x[i] * x[i] + y[i] * y[i] + z[i] * z[i] );
+    return r2;
+}
+
+float
+computeRadius(const Points& p)
+{
+    if ( p.size() == 0 ) { return 0.0f; }
+
+    float part[MaxChunks];
+    unsigned chunks = parallelFor( p.size(), [&]( size_t b, size_t e, unsigned c ) {
+	part[c] = radiusRange( p, b, e );
+    } );
+    float r2 = 0.0f;
+    for ( unsigned c = 0; c < chunks; ++c ) r2 = fmaxf( r2, part[c] );
+    return sqrtf( r2 );
+}
@@ -0,0 +1,39 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- Batch.h ---
+//
+//   Bounds of many points at once.  Points are kept as three separate
+//   streams (x[], y[], z[]), so one SIMD register holds the same coordinate
+//   of four (SSE) or eight (AVX) points.
+//
+//   Large batches are split over the job system's threads; below
+//   BatchParallelMin points everything runs on the calling thread.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <vector>
+#include <stddef.h>
+#include "Angel-yjc.h"
+
+const size_t BatchParallelMin = 1 << 15;
+
+// n points (or directions) in structure-of-arrays layout
+struct Points {
+    std::vector<float> x, y, z;
+
+    size_t size() const { return x.size(); }
+    void resize( size_t n ) { x.resize( n ); y.resize( n ); z.resize( n ); }
+    void set( size_t i, const vec3& p ) { x[i] = p.x; y[i] = p.y; z[i] = p.z; }
+    vec3 get( size_t i ) const { return vec3( x[i], y[i], z[i] ); }
+};
+
+// Axis-aligned bounds of the points; lo > hi if there are none
+void computeAABB( const Points& p, vec3& lo, vec3& hi );
+
+// Radius of the bounding sphere of the points about the origin
+float computeRadius( const Points& p );
+
+#endif // __BATCH_H__
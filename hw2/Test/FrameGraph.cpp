@@ -0,0 +1,94 @@
+#include <stddef.h>
+#include <stdio.h>
+#include "FrameGraph.h"
+
+int
+FrameGraph::addPass(const char* name, unsigned reads, unsigned writes,
+		    int mergeGroup)
+{
+    Pass p = { name, reads, writes, mergeGroup, true, -1, 0, writes };
+    _passes.push_back( p );
+    return int(_passes.size()) - 1;
+}
+
+// True if pass b has to run after pass a: b only reads something a writes
+// (every writer of a resource goes before its plain readers, whatever the
+// declaration order), or both write the same resource and a was declared
+// first (blending and depth testing depend on the order of the writers).
+static bool
+dependsOn(int a, unsigned aWrites, int b, unsigned bReads, unsigned bWrites)
+{
+    return (bReads & aWrites & ~bWrites) || (a < b && (bWrites & aWrites));
+}
+
+void
+FrameGraph::compile(unsigned outputs)
+{
+    int n = int(_passes.size());
+    int wasCyclic = cyclic;
+    executed = culled = merged = cyclic = 0;
+
+    // 1. Topological order of the enabled passes.  The graph is tiny, so
+    //    repeatedly take the first declared pass whose dependencies are all
+    //    placed.  Passes left over form a cycle; they are reported and run
+    //    in declaration order.
+    _order.clear();
+    std::vector<bool> placed( n, false );
+    for ( int i = 0; i < n; ++i ) {
+	_passes[i].slot = -1;
+	_passes[i].subpass = 0;
+	_passes[i].finalWrites = _passes[i].writes;
+	if ( !_passes[i].enabled ) { placed[i] = true; ++culled; }
+    }
+    for ( ;; ) {
+	int next = -1;
+	for ( int j = 0; j < n && next < 0; ++j ) {
+	    if ( placed[j] ) { continue; }
+	    bool ready = true;
+	    for ( int i = 0; i < n && ready; ++i )
+		if ( !placed[i] && i != j &&
+		     dependsOn( i, _passes[i].writes,
+				j, _passes[j].reads, _passes[j].writes ) )
+		    ready = false;
+	    if ( ready ) { next = j; }
+	}
+	if ( next < 0 ) { break; }
+	placed[next] = true;
+	_order.push_back( next );
+    }
+    for ( int i = 0; i < n; ++i ) {
+	if ( placed[i] ) { continue; }
+	if ( wasCyclic == 0 )
+	    fprintf( stderr, "FrameGraph: pass \"%s\" is part of a dependency cycle\n",
+		     _passes[i].name );
+	_order.push_back( i );
+	++cyclic;
+    }
+
+    // 2. Cull backwards from the outputs.  Writes never fully replace a
+    //    resource here (blending, partial coverage), so they don't end
+    //    its liveness; a pass is live if anything it writes is read later.
+    unsigned live = outputs;
+    for ( int k = int(_order.size()) - 1; k >= 0; --k ) {
+	Pass& p = _passes[_order[k]];
+	if ( p.writes & live ) {
+	    p.finalWrites = p.writes & (live | p.reads);
+	    live |= p.reads;
+	}
+	else { _order.erase( _order.begin() + k ); ++culled; }
+    }
+
+    // 3. Merge neighbours of the same group and hand out slots
+    Pass* prev = NULL;
+    for ( size_t k = 0; k < _order.size(); ++k ) {
+	Pass& p = _passes[_order[k]];
+	if ( prev != NULL && p.mergeGroup != 0 && p.mergeGroup == prev->mergeGroup &&
+	     prev->subpass + 1 < MaxSubpasses ) {
+	    p.slot = prev->slot;
+	    p.subpass = prev->subpass + 1;
+	    ++merged;
+	}
+	else { p.slot = executed++; }
+	prev = &p;
+    }
+}
@@ -0,0 +1,77 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- FrameGraph.h ---
+//
+//   The passes of a frame, declared with the framebuffer resources they
+//   read and write.  compile() runs once per frame and
+//
+//     1. orders the enabled passes so every pass runs after the passes
+//        it depends on: all writers of a resource before the passes that
+//        only read it, and writers of the same resource in declaration
+//        order.  Otherwise declaration order is kept.  Passes on a
+//        dependency cycle are reported and run in declaration order;
+//     2. culls passes whose writes are never read by a later pass or by
+//        the frame output, and drops the writes of a live pass that
+//        nothing reads (unless the pass reads them itself);
+//     3. merges a pass into the one right before it when both carry the
+//        same non-zero merge group (passes drawing into the same target).
+//        Merged passes share one slot, so the target is bound once; each
+//        keeps its own draws and write mask and subpass() keeps them in
+//        declaration order within the slot.
+//
+//   Afterwards runs() tells whether a pass still issues draws, slot() and
+//   subpass() are its position for RenderQueue keys and writes() its final
+//   write mask.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __FRAMEGRAPH_H__
+#define __FRAMEGRAPH_H__
+
+#include <vector>
+
+class FrameGraph {
+   public:
+    // Framebuffer resources; the application numbers its own (render
+    // textures and the like) from FirstUserResource up, one bit each
+    enum Resource { Color = 1, Depth = 2, Stencil = 4, FirstUserResource = 8 };
+
+    FrameGraph() : executed(0), culled(0), merged(0), cyclic(0) {}
+
+    // Returns the pass id; ids are handed out in declaration order
+    int addPass( const char* name, unsigned reads, unsigned writes,
+		 int mergeGroup = 0 );
+
+    void enable( int pass, bool on ) { _passes[pass].enabled = on; }
+
+    void compile( unsigned outputs = Color );
+
+    bool     runs( int pass ) const   { return _passes[pass].slot >= 0; }
+    unsigned slot( int pass ) const   { return _passes[pass].slot; }
+    unsigned subpass( int pass ) const { return _passes[pass].subpass; }
+    unsigned reads( int pass ) const  { return _passes[pass].reads; }
+    unsigned writes( int pass ) const { return _passes[pass].finalWrites; }
+    const char* name( int pass ) const { return _passes[pass].name; }
+
+    // Statistics of the last compile(); cyclic counts the passes that could
+    // not be ordered
+    int executed, culled, merged, cyclic;
+
+    enum { MaxSubpasses = 4 };  // merged passes per slot
+
+   private:
+    struct Pass {
+	const char* name;
+	unsigned    reads, writes;
+	int         mergeGroup;
+	bool        enabled;
+	int         slot;          // -1: does not run this frame
+	unsigned    subpass;       // position among the passes sharing slot
+	unsigned    finalWrites;
+    };
+
+    std::vector<Pass> _passes;
+    std::vector<int>  _order;      // scratch for compile()
+};
+
+#endif // __FRAMEGRAPH_H__
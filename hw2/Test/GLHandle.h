@@ -0,0 +1,89 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- GLHandle.h ---
+//
+//   Owning handles for GL objects.  A handle deletes its object when it
+//   is destroyed or given another one; it can be moved but not copied,
+//   so every object has exactly one owner.  Handles convert to GLuint,
+//   so they can be passed to GL and glState calls as they are.
+//
+//   Deletion goes through glState where the cache tracks bindings of
+//   that kind of object.  Handles should be reset while the context is
+//   current: main.cpp releases its global ones before exit() on 'q'.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __GLHANDLE_H__
+#define __GLHANDLE_H__
+
+#include "Angel-yjc.h"
+#include "GLState.h"
+
+template <class Kind>
+class GLHandle {
+   public:
+    GLHandle() : _id(0) {}
+    explicit GLHandle( GLuint id ) : _id(id) {}     // takes ownership
+    GLHandle( GLHandle&& other ) : _id(other._id) { other._id = 0; }
+    ~GLHandle() { reset(); }
+
+    GLHandle& operator=( GLHandle&& other ) {
+	if ( this != &other ) { reset( other.release() ); }
+	return *this;
+    }
+
+    GLHandle( const GLHandle& ) = delete;
+    GLHandle& operator=( const GLHandle& ) = delete;
+
+    // A new object of this kind
+    static GLHandle create() { return GLHandle( Kind::create() ); }
+
+    GLuint get() const { return _id; }
+    operator GLuint() const { return _id; }
+
+    // Give up ownership without deleting
+    GLuint release() { GLuint id = _id; _id = 0; return id; }
+
+    // Delete the object (unless it is "id") and own "id" instead
+    void reset( GLuint id = 0 ) {
+	if ( _id != 0 && _id != id ) { Kind::destroy( _id ); }
+	_id = id;
+    }
+
+   private:
+    GLuint _id;
+};
+
+struct GLBufferKind {
+    static GLuint create() { GLuint id; glGenBuffers( 1, &id ); return id; }
+    static void destroy( GLuint id ) { glState.deleteBuffer( id ); }
+};
+
+struct GLTextureKind {
+    static GLuint create() { GLuint id; glGenTextures( 1, &id ); return id; }
+    static void destroy( GLuint id ) { glState.deleteTexture( id ); }
+};
+
+struct GLFramebufferKind {
+    static GLuint create() { GLuint id; glGenFramebuffers( 1, &id ); return id; }
+    static void destroy( GLuint id ) { glState.deleteFramebuffer( id ); }
+};
+
+struct GLVertexArrayKind {
+    static GLuint create() { GLuint id; glGenVertexArrays( 1, &id ); return id; }
+    static void destroy( GLuint id ) { glDeleteVertexArrays( 1, &id ); }
+};
+
+// Programs come from SubmitShader(); see finishProgram() in main.cpp
+struct GLProgramKind {
+    static GLuint create() { return glCreateProgram(); }
+    static void destroy( GLuint id ) { glState.deleteProgram( id ); }
+};
+
+typedef GLHandle<GLBufferKind>      GLBuffer;
+typedef GLHandle<GLTextureKind>     GLTexture;
+typedef GLHandle<GLFramebufferKind> GLFramebuffer;
+typedef GLHandle<GLVertexArrayKind> GLVertexArray;
+typedef GLHandle<GLProgramKind>     GLProgram;
+
+#endif // __GLHANDLE_H__
@@ -0,0 +1,196 @@
+#include "GLState.h"
+
+GLState glState;
+
+// Slot in _caps[] for the capabilities we track, -1 for the rest
+static int
+capIndex(GLenum cap)
+{
+    switch ( cap ) {
+    case GL_BLEND:               return 0;
+    case GL_DEPTH_TEST:          return 1;
+    case GL_CULL_FACE:           return 2;
+    case GL_POLYGON_OFFSET_FILL: return 3;
+    }
+    return -1;
+}
+
+void
+GLState::invalidate()
+{
+    _program = Unknown;
+    _arrayBuffer = _elementBuffer = Unknown;
+    _framebuffer = Unknown;
+    for ( int i = 0; i < 4; ++i )          _viewport[i] = Unknown;
+    _activeUnit = Unknown;
+    for ( int i = 0; i < MaxUnits; ++i )   _texture1D[i] = _texture2D[i] = Unknown;
+    for ( int i = 0; i < MaxCaps; ++i )    _caps[i] = Unknown;
+    _depthMask = _colorMask = _polygonMode = Unknown;
+    _attribs = 0;
+    _attribsKnown = 0;
+
+    issued = filtered = 0;
+    lastIssued = lastFiltered = 0;
+}
+
+void
+GLState::beginFrame()
+{
+    lastIssued = issued;
+    lastFiltered = filtered;
+    issued = filtered = 0;
+}
+
+void
+GLState::useProgram(GLuint program)
+{
+    if ( changed( _program, program ) )
+	glUseProgram( program );
+}
+
+void
+GLState::bindBuffer(GLenum target, GLuint buffer)
+{
+    GLint* cached = target == GL_ARRAY_BUFFER ? &_arrayBuffer :
+		    target == GL_ELEMENT_ARRAY_BUFFER ? &_elementBuffer : NULL;
+    if ( cached == NULL ) { ++issued; glBindBuffer( target, buffer ); return; }
+
+    if ( changed( *cached, buffer ) )
+	glBindBuffer( target, buffer );
+}
+
+void
+GLState::bindFramebuffer(GLuint framebuffer)
+{
+    if ( changed( _framebuffer, framebuffer ) )
+	glBindFramebuffer( GL_FRAMEBUFFER, framebuffer );
+}
+
+void
+GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    if ( _viewport[0] == x && _viewport[1] == y &&
+	 _viewport[2] == width && _viewport[3] == height ) {
+	++filtered;
+	return;
+    }
+    _viewport[0] = x;
+    _viewport[1] = y;
+    _viewport[2] = width;
+    _viewport[3] = height;
+    ++issued;
+    glViewport( x, y, width, height );
+}
+
+void
+GLState::activeTexture(GLenum unit)
+{
+    if ( changed( _activeUnit, unit - GL_TEXTURE0 ) )
+	glActiveTexture( unit );
+}
+
+void
+GLState::bindTexture(GLenum target, GLuint texture)
+{
+    // Bindings are cached per unit, for the first MaxUnits units
+    int unit = _activeUnit;
+    bool tracked = unit >= 0 && unit < MaxUnits;
+    GLint* cached = !tracked ? NULL :
+		    target == GL_TEXTURE_1D ? &_texture1D[unit] :
+		    target == GL_TEXTURE_2D ? &_texture2D[unit] : NULL;
+    if ( cached == NULL ) { ++issued; glBindTexture( target, texture ); return; }
+
+    if ( changed( *cached, texture ) )
+	glBindTexture( target, texture );
+}
+
+void
+GLState::enable(GLenum cap, bool on)
+{
+    int i = capIndex( cap );
+    if ( i >= 0 && !changed( _caps[i], on ) ) { return; }
+    if ( i < 0 ) { ++issued; }
+
+    if ( on ) glEnable( cap );
+    else      glDisable( cap );
+}
+
+void
+GLState::depthMask(GLboolean on)
+{
+    if ( changed( _depthMask, on ) )
+	glDepthMask( on );
+}
+
+void
+GLState::colorMask(GLboolean r, GLboolean g, GLboolean b, GLboolean a)
+{
+    GLint bits = (r ? 1 : 0) | (g ? 2 : 0) | (b ? 4 : 0) | (a ? 8 : 0);
+    if ( changed( _colorMask, bits ) )
+	glColorMask( r, g, b, a );
+}
+
+void
+GLState::polygonMode(GLenum mode)
+{
+    if ( changed( _polygonMode, mode ) )
+	glPolygonMode( GL_FRONT_AND_BACK, mode );
+}
+
+void
+GLState::deleteBuffer(GLuint buffer)
+{
+    if ( buffer == 0 ) { return; }
+    if ( _arrayBuffer == GLint(buffer) )   { _arrayBuffer = 0; }
+    if ( _elementBuffer == GLint(buffer) ) { _elementBuffer = 0; }
+    glDeleteBuffers( 1, &buffer );
+}
+
+void
+GLState::deleteTexture(GLuint texture)
+{
+    if ( texture == 0 ) { return; }
+    for ( int i = 0; i < MaxUnits; ++i ) {
+	if ( _texture1D[i] == GLint(texture) ) { _texture1D[i] = 0; }
+	if ( _texture2D[i] == GLint(texture) ) { _texture2D[i] = 0; }
+    }
+    glDeleteTextures( 1, &texture );
+}
+
+void
+GLState::deleteFramebuffer(GLuint framebuffer)
+{
+    if ( framebuffer == 0 ) { return; }
+    if ( _framebuffer == GLint(framebuffer) ) { _framebuffer = 0; }
+    glDeleteFramebuffers( 1, &framebuffer );
+}
+
+void
+GLState::deleteProgram(GLuint program)
+{
+    if ( program == 0 ) { return; }
+    // A current program lives on until it is replaced, so leave the
+    // cache unsure rather than claiming 0
+    if ( _program == GLint(program) ) { _program = Unknown; }
+    glDeleteProgram( program );
+}
+
+void
+GLState::vertexAttribArrays(unsigned mask)
+{
+    // One comparison for the whole set; only the arrays that differ (or
+    // whose state is unknown) reach the driver, one call each
+    const unsigned all = (1u << MaxAttribs) - 1;
+    mask &= all;
+    unsigned diff = ((mask ^ _attribs) | ~_attribsKnown) & all;
+    if ( diff == 0 ) { ++filtered; return; }
+
+    for ( int i = 0; i < MaxAttribs; ++i ) {
+	if ( !(diff & (1u << i)) ) { continue; }
+	++issued;
+	if ( mask & (1u << i) ) glEnableVertexAttribArray( i );
+	else                    glDisableVertexAttribArray( i );
+    }
+    _attribs = mask;
+    _attribsKnown = all;
+}
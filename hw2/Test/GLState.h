@@ -0,0 +1,83 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- GLState.h ---
+//
+//   Shadow copy of the GL state that display() touches every frame.
+//   Each setter compares against the last value it sent and skips the
+//   driver call when nothing would change.  All hw2 drawing code goes
+//   through the global "glState", so the cache always matches the context.
+//
+//   issued / filtered count the calls of the current frame; beginFrame()
+//   moves them to lastIssued / lastFiltered and starts a new count.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __GLSTATE_H__
+#define __GLSTATE_H__
+
+#include "Angel-yjc.h"
+
+class GLState {
+   public:
+    GLState() { invalidate(); }
+
+    // Forget every cached value, e.g. after GL calls that bypassed the cache
+    void invalidate();
+
+    void beginFrame();
+
+    void useProgram( GLuint program );
+    void bindBuffer( GLenum target, GLuint buffer );
+    void bindFramebuffer( GLuint framebuffer );         // GL_FRAMEBUFFER
+    void viewport( GLint x, GLint y, GLsizei width, GLsizei height );
+    void activeTexture( GLenum unit );                  // GL_TEXTUREi
+    void bindTexture( GLenum target, GLuint texture );  // on the active unit
+    void enable( GLenum cap, bool on );
+    void depthMask( GLboolean on );
+    void colorMask( GLboolean r, GLboolean g, GLboolean b, GLboolean a );
+    void polygonMode( GLenum mode );                    // GL_FRONT_AND_BACK
+
+    // Delete an object and drop it from the cached bindings, as GL itself
+    // unbinds it; otherwise a new object reusing the name would be taken
+    // for one that is already bound
+    void deleteBuffer( GLuint buffer );
+    void deleteTexture( GLuint texture );
+    void deleteFramebuffer( GLuint framebuffer );
+    void deleteProgram( GLuint program );
+
+    // Enable exactly the vertex attribute arrays whose bits are set in mask
+    void vertexAttribArrays( unsigned mask );
+    static unsigned attribBit( GLint location )  // -1 (inactive) gives 0
+	{ return location >= 0 && location < MaxAttribs ? 1u << location : 0; }
+
+    unsigned issued, filtered;
+    unsigned lastIssued, lastFiltered;
+
+    enum { MaxCaps = 4, MaxAttribs = 16, MaxUnits = 4, Unknown = -1 };
+
+   private:
+    // Count one call and report whether it has to reach the driver
+    bool changed( GLint& cached, GLint value ) {
+	if ( cached == value ) { ++filtered; return false; }
+	cached = value;
+	++issued;
+	return true;
+    }
+
+    GLint  _program;
+    GLint  _arrayBuffer, _elementBuffer;
+    GLint  _framebuffer;
+    GLint  _viewport[4];
+    GLint  _activeUnit;  // 0 for GL_TEXTURE0
+    GLint  _texture1D[MaxUnits], _texture2D[MaxUnits];
+    GLint  _caps[MaxCaps];
+    GLint  _depthMask;
+    GLint  _colorMask;   // RGBA bits packed into one value
+    GLint  _polygonMode;
+    unsigned _attribs;       // enabled vertex attribute arrays, one bit each
+    unsigned _attribsKnown;  // bits of _attribs that match the context
+};
+
+extern GLState glState;
+
+#endif // __GLSTATE_H__
@@ -1,10 +1,24 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <map>
+#include <string>
+
+#ifdef _WIN32
+#  include <direct.h>
+#  define MakeDir( dir )  _mkdir( dir )
+#else
+#  include <sys/stat.h>
+#  define MakeDir( dir )  mkdir( dir, 0755 )
+#endif
 
 #include "Angel-yjc.h"
 
 namespace Angel {
 
+// Linked programs are cached here as <hash>.bin (see InitShader below)
+static const char* ShaderCacheDir = "shader_cache";
+static const GLuint ShaderCacheMagic = 0x42505347;  // "GSPB"
+
 // Create a NULL-terminated string by reading the provided file
 static char*
 readShaderSource(const char* shaderFile)
@@ -36,10 +50,157 @@ readShaderSource(const char* shaderFile)
     return buf;
 }
 
+//----------------------------------------------------------------------------
+// Program binary cache
+//
+// The cache key is a 64-bit FNV-1a hash over both shader sources and the
+// GL vendor/renderer/version strings, so editing a shader or updating the
+// driver simply misses the cache instead of loading a stale binary.
+
+static unsigned long long
+hashString(unsigned long long h, const char* str)
+{
+    // Hash the terminating '\0' too, so ("ab","c") and ("a","bc") differ
+    do {
+        h ^= (unsigned char) *str;
+        h *= 1099511628211ULL;
+    } while ( *str++ != '\0' );
+    return h;
+}
+
+static bool
+programBinarySupported()
+{
+#ifndef __APPLE__
+    if ( !GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary ) { return false; }
+#endif
+    GLint formats = 0;
+    glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &formats );
+    return formats > 0;
+}
+
+static std::string
+programCachePath(const char* vSource, const char* fSource)
+{
+    unsigned long long h = 14695981039346656037ULL;
+    h = hashString( h, vSource );
+    h = hashString( h, fSource );
+    h = hashString( h, (const char*) glGetString( GL_VENDOR ) );
+    h = hashString( h, (const char*) glGetString( GL_RENDERER ) );
+    h = hashString( h, (const char*) glGetString( GL_VERSION ) );
+
+    char name[32];
+    sprintf_s( name, sizeof(name), "/%016llx.bin", h );
+    return std::string( ShaderCacheDir ) + name;
+}
+
+// Try to initialize "program" from a cached binary.  Returns false if there
+// is no cache entry or the driver rejects it; a rejected entry is removed.
+static bool
+loadProgramBinary(GLuint program, const std::string& path)
+{
+    FILE* fp;
+    fopen_s( &fp, path.c_str(), "rb" );
+    if ( fp == NULL ) { return false; }
+
+    GLuint header[3];  // magic, binary format, binary length
+    bool ok = fread( header, sizeof(header), 1, fp ) == 1 &&
+              header[0] == ShaderCacheMagic && header[2] > 0;
+    if ( ok ) {
+        char* binary = new char[header[2]];
+        ok = fread( binary, 1, header[2], fp ) == header[2];
+        if ( ok ) {
+            glProgramBinary( program, header[1], binary, header[2] );
+
+            GLint  linked;
+            glGetProgramiv( program, GL_LINK_STATUS, &linked );
+            ok = linked != 0;
+        }
+        delete [] binary;
+    }
+    fclose( fp );
+
+    if ( !ok ) {
+        printf( "Discarding stale shader cache entry %s\n", path.c_str() );
+        remove( path.c_str() );
+    }
+    return ok;
+}
+
+static void
+saveProgramBinary(GLuint program, const std::string& path)
+{
+    GLint length = 0;
+    glGetProgramiv( program, GL_PROGRAM_BINARY_LENGTH, &length );
+    if ( length <= 0 ) { return; }
+
+    char* binary = new char[length];
+    GLenum format;
+    glGetProgramBinary( program, length, NULL, &format, binary );
+
+    MakeDir( ShaderCacheDir );  // fails harmlessly if it already exists
+    FILE* fp;
+    fopen_s( &fp, path.c_str(), "wb" );
+    if ( fp != NULL ) {
+        GLuint header[3] = { ShaderCacheMagic, format, GLuint(length) };
+        fwrite( header, sizeof(header), 1, fp );
+        fwrite( binary, 1, length, fp );
+        fclose( fp );
+    }
+    delete [] binary;
+}
+
+
+//----------------------------------------------------------------------------
+// Compile queue
+//
+// SubmitShader() issues every compile and link call without asking the
+// driver for the result, so drivers that compile on background threads
+// (KHR_parallel_shader_compile) can work while the caller loads meshes.
+// Status and info logs are only read by FinishShader(), which the caller
+// runs when the program is first needed.
+
+struct PendingProgram {
+    std::string  files;        // "vshader + fshader", for messages
+    GLuint       shaders[2];
+    std::string  cachePath;    // empty if program binaries are unsupported
+};
+
+static std::map<GLuint, PendingProgram> pendingPrograms;
+
+static void
+enableParallelCompile()
+{
+    static bool done = false;
+    if ( done ) { return; }
+    done = true;
+
+#ifndef __APPLE__
+    if ( GLEW_KHR_parallel_shader_compile ) {
+		glMaxShaderCompilerThreadsKHR( 0xFFFFFFFF );  // driver's choice
+    }
+#endif
+}
+
+static void
+printShaderLog(GLuint shader, const char* what)
+{
+    GLint  logSize;
+    glGetShaderiv( shader, GL_INFO_LOG_LENGTH, &logSize );
+    char* logMsg = new char[logSize + 1];
+    logMsg[0] = '\0';
+    glGetShaderInfoLog( shader, logSize + 1, NULL, logMsg );
+    std::cerr << what << " failed to compile:" << std::endl
+	      << logMsg << std::endl;
+    delete [] logMsg;
+}
 
-// Create a GLSL program object from vertex and fragment shader files
+// Create a GLSL program object from vertex and fragment shader files and
+// queue it for compiling.  The returned id must go through FinishShader()
+// before use.  If the driver supports program binaries, a previously
+// linked copy is loaded from ShaderCacheDir instead of compiling.
 GLuint
-InitShader(const char* vShaderFile, const char* fShaderFile)
+SubmitShader(const char* vShaderFile, const char* fShaderFile)
 {
     struct Shader {
 		const char*  filename;
@@ -50,59 +211,119 @@ InitShader(const char* vShaderFile, const char* fShaderFile)
 		{ fShaderFile, GL_FRAGMENT_SHADER, NULL }
     };
 
-    GLuint program = glCreateProgram();
-    
+    enableParallelCompile();
+
+    PendingProgram pending;
+    pending.files = std::string( vShaderFile ) + " + " + fShaderFile;
+
     for ( int i = 0; i < 2; ++i ) {
 		Shader& s = shaders[i];
 		s.source = readShaderSource( s.filename );
-		if ( shaders[i].source == NULL ) {
+		if ( s.source == NULL ) {
 			std::cerr << "Failed to read " << s.filename << std::endl;
-			getchar();
-			//exit( EXIT_FAILURE );	
+			delete [] shaders[0].source;
+			return 0;
 		}
-		else printf("Successfully read %s\n", s.filename);
+    }
 
-		GLuint shader = glCreateShader( s.type );
-		glShaderSource( shader, 1, (const GLchar**) &s.source, NULL );
-		glCompileShader( shader );
+    GLuint program = glCreateProgram();
 
-		GLint  compiled;
-		glGetShaderiv( shader, GL_COMPILE_STATUS, &compiled );
-		if ( !compiled ) {
-			std::cerr << s.filename << " failed to compile:" << std::endl;
-			GLint  logSize;
-			glGetShaderiv( shader, GL_INFO_LOG_LENGTH, &logSize );
-			char* logMsg = new char[logSize];
-			glGetShaderInfoLog( shader, logSize, NULL, logMsg );
-			std::cerr << logMsg << std::endl;
-			delete [] logMsg;
-			getchar();
-			//exit( EXIT_FAILURE );
+    if ( programBinarySupported() ) {
+		pending.cachePath = programCachePath( shaders[0].source, shaders[1].source );
+		if ( loadProgramBinary( program, pending.cachePath ) ) {
+			printf("Loaded %s from %s\n",
+			       pending.files.c_str(), pending.cachePath.c_str());
+			delete [] shaders[0].source;
+			delete [] shaders[1].source;
+			return program;
 		}
-		else printf("Successfully compiled %s\n", s.filename);
+		// A rejected binary leaves the program unlinked; start over clean
+		glDeleteProgram( program );
+		program = glCreateProgram();
+    }
 
+    for ( int i = 0; i < 2; ++i ) {
+		Shader& s = shaders[i];
+
+		GLuint shader = glCreateShader( s.type );
+		glShaderSource( shader, 1, (const GLchar**) &s.source, NULL );
+		glCompileShader( shader );
 		delete [] s.source;
 
 		glAttachShader( program, shader );
+		pending.shaders[i] = shader;
     }
 
-    /* link and error check */
+    if ( !pending.cachePath.empty() )
+		glProgramParameteri( program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
     glLinkProgram(program);
 
+    pendingPrograms[program] = pending;
+    return program;
+}
+
+// True once FinishShader(program) will not stall waiting for the driver.
+// Without KHR_parallel_shader_compile there is no way to ask, so this
+// always reports true.
+bool
+ShaderReady(GLuint program)
+{
+    if ( pendingPrograms.find( program ) == pendingPrograms.end() ) { return true; }
+
+#ifndef __APPLE__
+    if ( GLEW_KHR_parallel_shader_compile ) {
+		GLint  done;
+		glGetProgramiv( program, GL_COMPLETION_STATUS_KHR, &done );
+		return done != 0;
+    }
+#endif
+    return true;
+}
+
+// Check the link status of a program from SubmitShader(), printing any
+// compiler or linker log.  Returns the program, or 0 if it failed to build
+// (the failed program object is deleted).  Already finished programs are
+// returned as is, so this is cheap to call every frame.
+GLuint
+FinishShader(GLuint program)
+{
+    std::map<GLuint, PendingProgram>::iterator it = pendingPrograms.find( program );
+    if ( it == pendingPrograms.end() ) { return program; }
+    PendingProgram& pending = it->second;
+
     GLint  linked;
     glGetProgramiv( program, GL_LINK_STATUS, &linked );
     if ( !linked ) {
-		std::cerr << "Shader program failed to link" << std::endl;
+		std::cerr << pending.files << ": shader program failed to link" << std::endl;
+		for ( int i = 0; i < 2; ++i ) {
+			GLint  compiled;
+			glGetShaderiv( pending.shaders[i], GL_COMPILE_STATUS, &compiled );
+			if ( !compiled )
+				printShaderLog( pending.shaders[i], pending.files.c_str() );
+		}
 		GLint  logSize;
 		glGetProgramiv( program, GL_INFO_LOG_LENGTH, &logSize);
-		char* logMsg = new char[logSize];
-		glGetProgramInfoLog( program, logSize, NULL, logMsg );
+		char* logMsg = new char[logSize + 1];
+		logMsg[0] = '\0';
+		glGetProgramInfoLog( program, logSize + 1, NULL, logMsg );
 		std::cerr << logMsg << std::endl;
 		delete [] logMsg;
-		getchar();
-		//exit( EXIT_FAILURE );
     }
-    else printf("Successfully linked program object\n\n");
+    else {
+		printf("Successfully built %s\n", pending.files.c_str());
+		if ( !pending.cachePath.empty() )
+			saveProgramBinary( program, pending.cachePath );
+    }
+
+    // Shaders are flagged for deletion; they go away with the program
+    for ( int i = 0; i < 2; ++i )
+		glDeleteShader( pending.shaders[i] );
+    pendingPrograms.erase( it );
+
+    if ( !linked ) {
+		glDeleteProgram( program );
+		return 0;
+    }
 
 #if 0 /* YJC: Do NOT use this program obj yet!
               Call glUseProgram() outside, in suitable places inside display(),
@@ -115,4 +336,12 @@ InitShader(const char* vShaderFile, const char* fShaderFile)
     return program;
 }
 
+// Create a GLSL program object from vertex and fragment shader files,
+// waiting for it to finish building
+GLuint
+InitShader(const char* vShaderFile, const char* fShaderFile)
+{
+    return FinishShader( SubmitShader( vShaderFile, fShaderFile ) );
+}
+
 }  // Close namespace Angel block
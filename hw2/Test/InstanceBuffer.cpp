@@ -0,0 +1,29 @@
+#include "InstanceBuffer.h"
+#include "GLState.h"
+
+void
+InstanceBuffer::create(GLenum unit)
+{
+    _buffer = GLBuffer::create();
+    glState.bindBuffer( GL_TEXTURE_BUFFER, _buffer );
+    glBufferData( GL_TEXTURE_BUFFER, sizeof(vec4) * InstanceData::Texels, NULL,
+		  GL_STREAM_DRAW );
+
+    _texture = GLTexture::create();
+    glState.activeTexture( unit );
+    glState.bindTexture( GL_TEXTURE_BUFFER, _texture );
+    glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32F, _buffer );
+    glState.activeTexture( GL_TEXTURE0 );
+}
+
+void
+InstanceBuffer::upload(const std::vector<vec4>& texels)
+{
+    if ( texels.empty() ) { return; }
+
+    // Fresh storage every frame, so the driver never waits for the
+    // draws of the previous frame that still read the old contents
+    glState.bindBuffer( GL_TEXTURE_BUFFER, _buffer );
+    glBufferData( GL_TEXTURE_BUFFER, sizeof(vec4) * texels.size(), &texels[0],
+		  GL_STREAM_DRAW );
+}
@@ -0,0 +1,59 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- InstanceBuffer.h ---
+//
+//   Per-instance data for instanced draws.  GL 3.2 has no per-instance
+//   vertex attributes (glVertexAttribDivisor is 3.3), so the data lives in
+//   a buffer texture that the vertex shaders read with texelFetch() at
+//   Texels * gl_InstanceID:
+//
+//     texel 0..2   rows of the instance's model transform (an affine)
+//     texel 3      material tint, multiplied into ambient and diffuse
+//
+//   InstanceData is the CPU side and needs no GL, so any thread can fill
+//   it; InstanceBuffer sends one to the GPU in one upload() per frame.
+//   The buffer texture stays bound to its texture unit.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __INSTANCEBUFFER_H__
+#define __INSTANCEBUFFER_H__
+
+#include <vector>
+#include "Angel-yjc.h"
+#include "GLHandle.h"
+
+struct InstanceData {
+    enum { Texels = 4 };
+
+    std::vector<vec4> texels;
+
+    void resize( int n ) { texels.resize( size_t(n) * Texels ); }
+    int size() const { return int(texels.size() / Texels); }
+
+    void set( int i, const affine& model, const vec4& tint ) {
+	vec4* t = &texels[size_t(i) * Texels];
+	t[0] = model[0];
+	t[1] = model[1];
+	t[2] = model[2];
+	t[3] = tint;
+    }
+};
+
+class InstanceBuffer {
+   public:
+    // Create the buffer and bind its texture to "unit" (GL_TEXTUREi)
+    void create( GLenum unit );
+
+    void upload( const InstanceData& data ) { upload( data.texels ); }
+    void upload( const std::vector<vec4>& texels );
+
+    // Delete the buffer and its texture
+    void release() { _texture.reset(); _buffer.reset(); }
+
+   private:
+    GLBuffer  _buffer;
+    GLTexture _texture;
+};
+
+#endif // __INSTANCEBUFFER_H__
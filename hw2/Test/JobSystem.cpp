@@ -0,0 +1,183 @@
+#include "JobSystem.h"
+
+JobSystem jobSystem;
+
+// Queue of the calling thread: its own if it is a worker of "owner"
+static thread_local const JobSystem* tlsOwner = nullptr;
+static thread_local unsigned tlsQueue = 0;
+
+void
+JobSystem::start(unsigned workers)
+{
+    stop();
+    if ( workers == 0 ) {
+	unsigned hw = std::thread::hardware_concurrency();
+	workers = hw > 1 ? hw - 1 : 1;
+    }
+    _stopping = false;
+    for ( unsigned i = 0; i < workers; ++i )
+	_queues.emplace_back( new Queue );
+    for ( unsigned i = 0; i < workers; ++i )
+	_workers.push_back( std::thread( &JobSystem::workerLoop, this, i + 1 ) );
+}
+
+void
+JobSystem::stop()
+{
+    if ( _workers.empty() ) { return; }
+    {
+	std::lock_guard<std::mutex> guard( _sleepLock );
+	_stopping = true;
+    }
+    _wake.notify_all();
+    for ( size_t i = 0; i < _workers.size(); ++i ) _workers[i].join();
+    _workers.clear();
+
+    // Jobs the workers left behind go to the shared queue
+    for ( size_t q = 1; q < _queues.size(); ++q )
+	for ( size_t i = 0; i < _queues[q]->jobs.size(); ++i )
+	    _queues[0]->jobs.push_back( _queues[q]->jobs[i] );
+    _queues.resize( 1 );
+}
+
+JobSystem::Job
+JobSystem::run(std::function<void()> f, const std::vector<Job>& after)
+{
+    return submit( std::move( f ), after, false );
+}
+
+JobSystem::Job
+JobSystem::runBackground(std::function<void()> f, const std::vector<Job>& after)
+{
+    return submit( std::move( f ), after, true );
+}
+
+JobSystem::Job
+JobSystem::submit(std::function<void()> f, const std::vector<Job>& after, bool background)
+{
+    Job job = std::make_shared<Task>();
+    job->f = std::move( f );
+    job->background = background;
+    for ( size_t i = 0; i < after.size(); ++i ) {
+	Task& prev = *after[i];
+	std::lock_guard<std::mutex> guard( prev.lock );
+	if ( prev.finished ) { continue; }
+	++job->waitingFor;
+	prev.next.push_back( job );
+    }
+    prerequisiteDone( job );   // drop the +1 held while adding
+    return job;
+}
+
+void
+JobSystem::prerequisiteDone(const Job& job)
+{
+    if ( --job->waitingFor == 0 ) { push( job ); }
+}
+
+void
+JobSystem::push(const Job& job)
+{
+    Queue& q = job->background ? _background : *_queues[tlsOwner == this ? tlsQueue : 0];
+    {
+	std::lock_guard<std::mutex> guard( q.lock );
+	q.jobs.push_back( job );
+    }
+    ++_queued;
+    if ( !_workers.empty() ) {
+	// Taking the lock orders this with a worker about to sleep
+	std::lock_guard<std::mutex> guard( _sleepLock );
+	_wake.notify_one();
+    }
+}
+
+JobSystem::Job
+JobSystem::pop(unsigned self, bool background)
+{
+    Job job;
+    if ( _queued == 0 ) { return job; }
+
+    // Own queue from the back, newest first
+    {
+	Queue& q = *_queues[self];
+	std::lock_guard<std::mutex> guard( q.lock );
+	if ( !q.jobs.empty() ) {
+	    job = q.jobs.back();
+	    q.jobs.pop_back();
+	}
+    }
+
+    // Steal from the front of the others, starting after our own
+    for ( size_t k = 1; !job && k < _queues.size(); ++k ) {
+	Queue& q = *_queues[(self + k) % _queues.size()];
+	std::lock_guard<std::mutex> guard( q.lock );
+	if ( !q.jobs.empty() ) {
+	    job = q.jobs.front();
+	    q.jobs.pop_front();
+	}
+    }
+
+    // Background jobs last, oldest first
+    if ( !job && background ) {
+	std::lock_guard<std::mutex> guard( _background.lock );
+	if ( !_background.jobs.empty() ) {
+	    job = _background.jobs.front();
+	    _background.jobs.pop_front();
+	}
+    }
+    if ( job ) { --_queued; }
+    return job;
+}
+
+void
+JobSystem::execute(const Job& job)
+{
+    job->f();
+    job->f = nullptr;   // release captures now, not when the last Job goes
+
+    std::vector<Job> next;
+    {
+	std::lock_guard<std::mutex> guard( job->lock );
+	job->finished = true;
+	next.swap( job->next );
+    }
+    for ( size_t i = 0; i < next.size(); ++i ) prerequisiteDone( next[i] );
+}
+
+void
+JobSystem::wait(const Job& job)
+{
+    unsigned self = tlsOwner == this ? tlsQueue : 0;
+    while ( !job->finished ) {
+	Job other = pop( self, false );
+	if ( other ) { execute( other ); }
+	else { std::this_thread::yield(); }   // what's left runs elsewhere
+    }
+}
+
+size_t
+JobSystem::chunkSize(size_t n, size_t minStep, size_t align, unsigned perThread) const
+{
+    size_t chunks = size_t( threads() ) * perThread;
+    size_t step = (n + chunks - 1) / chunks;
+    if ( step < minStep ) { step = minStep; }
+    if ( align > 1 ) { step = (step + align - 1) / align * align; }
+    return step > 0 ? step : 1;
+}
+
+void
+JobSystem::workerLoop(unsigned self)
+{
+    tlsOwner = this;
+    tlsQueue = self;
+    for ( ;; ) {
+	Job job = pop( self, true );
+	if ( job ) {
+	    execute( job );
+	    continue;
+	}
+	std::unique_lock<std::mutex> guard( _sleepLock );
+	if ( _stopping ) { return; }
+	_wake.wait( guard, [this]() { return _queued > 0 || _stopping; } );
+    }
+}
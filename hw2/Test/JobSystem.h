@@ -0,0 +1,128 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- JobSystem.h ---
+//
+//   Work-stealing thread pool.  Every worker owns a deque of jobs: it
+//   pushes and pops its own at the back (newest first, still in cache)
+//   and, when it runs dry, steals from the front of another's (oldest
+//   first, usually the biggest piece of work).  Threads that are not
+//   workers (main, simulation) share deque 0.
+//
+//   A job may wait for other jobs; it is queued only once all of them
+//   have finished.  wait() never just blocks: the waiting thread runs
+//   queued jobs until the one it waits for is done.  So the main thread
+//   participates, nested parallelFor() calls inside jobs cannot deadlock,
+//   and with no workers at all (before start(), or start(0)) everything
+//   runs on the thread that waits.
+//
+//   Background jobs (file loading and the like) are the exception: only
+//   workers run them, and only when there is nothing else to do, so a
+//   wait() in the middle of a frame never picks one up.  start() always
+//   starts at least one worker for them.
+//
+//   All hw2 code uses the global "jobSystem"; main() starts its workers.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __JOBSYSTEM_H__
+#define __JOBSYSTEM_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem {
+    struct Task;
+
+   public:
+    typedef std::shared_ptr<Task> Job;
+
+    JobSystem() : _queued(0), _stopping(false) { _queues.emplace_back( new Queue ); }
+    ~JobSystem() { stop(); }
+
+    // Start "workers" threads; 0 means one per hardware thread but the
+    // caller's, at least one.  stop() joins them; jobs they left queued
+    // wait for the next start() or wait().
+    void start( unsigned workers = 0 );
+    void stop();
+
+    // Threads that run jobs: the workers plus the waiting thread
+    unsigned threads() const { return unsigned(_workers.size()) + 1; }
+
+    // Queue f to run once every job in "after" has finished
+    Job run( std::function<void()> f, const std::vector<Job>& after = std::vector<Job>() );
+
+    // Queue f as a background job: workers only, see above
+    Job runBackground( std::function<void()> f,
+		       const std::vector<Job>& after = std::vector<Job>() );
+
+    bool done( const Job& job ) const { return job->finished; }
+
+    // Run other jobs until "job" has finished
+    void wait( const Job& job );
+
+    // f(begin, end, chunk) over [0, n) in chunks of "step" items; returns
+    // the number of chunks.  The calling thread runs the last chunk
+    // itself and helps with the others until all are done.
+    template <class F>
+    unsigned parallelFor( size_t n, size_t step, F f ) {
+	if ( step == 0 ) { step = 1; }
+	unsigned chunks = unsigned( (n + step - 1) / step );
+	if ( chunks <= 1 ) {
+	    if ( n > 0 ) { f( size_t(0), n, 0u ); }
+	    return chunks;
+	}
+	std::vector<Job> jobs;
+	jobs.reserve( chunks - 1 );
+	for ( unsigned c = 0; c + 1 < chunks; ++c )
+	    jobs.push_back( run( [&f, c, step]() { f( c * step, (c + 1) * step, c ); } ) );
+	f( (chunks - 1) * step, n, chunks - 1 );
+	for ( size_t i = 0; i < jobs.size(); ++i ) wait( jobs[i] );
+	return chunks;
+    }
+
+    // Chunk size that gives every thread about "perThread" chunks of at
+    // least "minStep" items, rounded up to a multiple of "align"
+    size_t chunkSize( size_t n, size_t minStep = 1, size_t align = 1,
+		      unsigned perThread = 4 ) const;
+
+   private:
+    struct Task {
+	std::function<void()> f;
+	std::atomic<int>      waitingFor;  // unfinished prerequisites, +1 while run() adds them
+	std::atomic<bool>     finished;
+	bool                  background;
+	std::mutex            lock;        // guards "next"
+	std::vector<Job>      next;        // jobs waiting for this one
+	Task() : waitingFor( 1 ), finished( false ), background( false ) {}
+    };
+
+    struct Queue {
+	std::mutex      lock;
+	std::deque<Job> jobs;
+    };
+
+    Job  submit( std::function<void()> f, const std::vector<Job>& after, bool background );
+    void push( const Job& job );
+    Job  pop( unsigned self, bool background );
+    void execute( const Job& job );
+    void prerequisiteDone( const Job& job );
+    void workerLoop( unsigned self );
+
+    std::vector<std::unique_ptr<Queue> > _queues;   // 0: non-worker threads
+    std::vector<std::thread>             _workers;  // worker i owns queue i + 1
+    Queue                                _background;
+    std::atomic<int>                     _queued;
+    std::atomic<bool>                    _stopping;
+    std::mutex                           _sleepLock;
+    std::condition_variable              _wake;
+};
+
+extern JobSystem jobSystem;
+
+#endif // __JOBSYSTEM_H__
@@ -0,0 +1,48 @@
+#include "MaterialTable.h"
+#include "GLState.h"
+
+void
+MaterialTable::create(GLenum unit)
+{
+    _buffer = GLBuffer::create();
+    glState.bindBuffer( GL_TEXTURE_BUFFER, _buffer );
+    glBufferData( GL_TEXTURE_BUFFER, sizeof(vec4) * Texels, NULL, GL_STATIC_DRAW );
+
+    _texture = GLTexture::create();
+    glState.activeTexture( unit );
+    glState.bindTexture( GL_TEXTURE_BUFFER, _texture );
+    glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32F, _buffer );
+    glState.activeTexture( GL_TEXTURE0 );
+    _changed = true;
+}
+
+int
+MaterialTable::add(const Material& m)
+{
+    _texels.resize( _texels.size() + Texels );
+    set( size() - 1, m );
+    return size() - 1;
+}
+
+void
+MaterialTable::set(int i, const Material& m)
+{
+    vec4* t = &_texels[size_t(i) * Texels];
+    t[0] = m.ambient;
+    t[1] = m.diffuse;
+    t[2] = m.specular;
+    t[3] = vec4( m.shininess, 0.0, 0.0, 0.0 );
+    _changed = true;
+}
+
+void
+MaterialTable::upload()
+{
+    if ( !_changed || _texels.empty() || _buffer == 0 ) { return; }
+
+    // Materials change rarely: new storage each time is simplest
+    glState.bindBuffer( GL_TEXTURE_BUFFER, _buffer );
+    glBufferData( GL_TEXTURE_BUFFER, sizeof(vec4) * _texels.size(), &_texels[0],
+		  GL_STATIC_DRAW );
+    _changed = false;
+}
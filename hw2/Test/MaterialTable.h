@@ -0,0 +1,58 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- MaterialTable.h ---
+//
+//   Every material in one buffer texture, Texels texels per material:
+//
+//     texel 0..2   ambient, diffuse, specular
+//     texel 3      shininess in x
+//
+//   A draw only names its material by index (ObjBuffer::material, the
+//   "material" uniform or the draw's multi-draw data) and the vertex
+//   shader fetches the rest, so changing a material is a set() and the
+//   next upload(), not new uniforms for every draw that uses it.
+//
+//   GL thread only for create(), upload() and release().
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __MATERIALTABLE_H__
+#define __MATERIALTABLE_H__
+
+#include <vector>
+#include "Angel-yjc.h"
+#include "GLHandle.h"
+
+struct Material {
+    vec4  ambient, diffuse, specular;
+    float shininess;
+};
+
+class MaterialTable {
+   public:
+    enum { Texels = 4 };
+
+    MaterialTable() : _changed( false ) {}
+
+    // Create the buffer and bind its texture to "unit" (GL_TEXTUREi)
+    void create( GLenum unit );
+
+    // Append m; returns its index
+    int add( const Material& m );
+    void set( int i, const Material& m );
+    int size() const { return int(_texels.size() / Texels); }
+
+    // Send the table to the GPU if it changed since the last upload()
+    void upload();
+
+    // Delete the buffer and its texture
+    void release() { _texture.reset(); _buffer.reset(); }
+
+   private:
+    std::vector<vec4> _texels;
+    bool              _changed;
+    GLBuffer          _buffer;
+    GLTexture         _texture;
+};
+
+#endif // __MATERIALTABLE_H__
@@ -0,0 +1,90 @@
+#include <string.h>
+#include "MeshLoader.h"
+#include "GLState.h"
+#include "JobSystem.h"
+
+MeshLoader::Arena
+MeshLoader::takeArena()
+{
+    std::lock_guard<std::mutex> guard( _lock );
+    if ( _spare.empty() ) { return Arena( new StagingArena ); }
+    Arena arena = std::move( _spare.back() );
+    _spare.pop_back();
+    return arena;
+}
+
+void
+MeshLoader::giveArena(Arena arena)
+{
+    arena->reset();
+    std::lock_guard<std::mutex> guard( _lock );
+    _spare.push_back( std::move( arena ) );
+}
+
+void
+MeshLoader::load(int tag, Parser parse)
+{
+    ++_loading;
+    jobSystem.runBackground( [this, tag, parse]() {
+	Finished f;
+	f.tag = tag;
+	f.arena = takeArena();
+	if ( !parse( f.mesh, *f.arena ) || f.mesh.vertices == 0 ) {
+	    giveArena( std::move( f.arena ) );
+	    --_loading;
+	    return;
+	}
+	std::lock_guard<std::mutex> guard( _lock );
+	_finished.push_back( std::move( f ) );
+    } );
+}
+
+bool
+MeshLoader::pump(size_t budget, LoadedMesh& done)
+{
+    if ( !_current ) {
+	std::lock_guard<std::mutex> guard( _lock );
+	if ( _finished.empty() ) { return false; }
+	_current.reset( new Finished( std::move( _finished.front() ) ) );
+	_finished.pop_front();
+	--_loading;
+    }
+
+    MeshData& mesh = _current->mesh;
+    size_t size = mesh.bytes();
+    if ( _block.buffer == 0 ) {
+	_block = _pool.allocate( size );
+	_uploaded = 0;
+    }
+
+    // The block may be one a mesh still in flight just freed, so the
+    // mapping is synchronized; invalidating the range lets the driver
+    // hand out fresh memory instead of waiting
+    size_t n = size - _uploaded < budget ? size - _uploaded : budget;
+    glState.bindBuffer( GL_ARRAY_BUFFER, _block.buffer );
+    void* dst = glMapBufferRange( GL_ARRAY_BUFFER, _block.offset + _uploaded, n,
+				  GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT );
+    const char* src = (const char*) mesh.data + _uploaded;
+    if ( dst ) {
+	memcpy( dst, src, n );
+	// False if the contents were lost meanwhile (display mode change
+	// and the like): start this mesh over
+	if ( !glUnmapBuffer( GL_ARRAY_BUFFER ) ) { _uploaded = 0; return false; }
+    }
+    else {
+	glBufferSubData( GL_ARRAY_BUFFER, _block.offset + _uploaded, n, src );
+    }
+    _uploaded += n;
+    if ( _uploaded < size ) { return false; }
+
+    done.tag = _current->tag;
+    done.block = _block;
+    done.vertices = mesh.vertices;
+    done.boundsMin = mesh.boundsMin;
+    done.boundsMax = mesh.boundsMax;
+    done.radius = mesh.radius;
+    giveArena( std::move( _current->arena ) );
+    _current.reset();
+    _block.buffer = 0;
+    return true;
+}
@@ -0,0 +1,104 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- MeshLoader.h ---
+//
+//   Loads meshes without stalling frames.  load() parses a file as a
+//   background job (see JobSystem.h) into a MeshData, which already is
+//   what the vertex buffer will hold: an array of Vertex (main.h).
+//
+//   The parser builds the mesh (and its scratch data, such as the file's
+//   text) in a StagingArena, so a load makes no heap allocations of its
+//   own.  Arenas are recycled: after the upload the arena goes back to a
+//   spare list for the next load.
+//
+//   Finished meshes wait in a completion queue.  The GL thread calls
+//   pump() regularly; each call maps the next part of the current mesh's
+//   block in the VertexPool and copies at most "budget" bytes into it, so a huge model
+//   streams in over several calls instead of one long upload.  A mesh is
+//   handed out only when all of it is on the GPU.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __MESHLOADER_H__
+#define __MESHLOADER_H__
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Angel-yjc.h"
+#include "main.h"
+#include "StagingArena.h"
+#include "VertexPool.h"
+
+struct MeshData {
+    int     vertices;
+    Vertex* data;
+    vec3    boundsMin, boundsMax;
+    float   radius;     // bounding sphere about the origin
+
+    MeshData() : vertices(0), data(nullptr), radius(0.0f) {}
+
+    // Room for n vertices in "arena", uninitialized
+    void allocate( StagingArena& arena, int n ) {
+	vertices = n;
+	data = arena.allocate<Vertex>( size_t(n) );
+    }
+    size_t bytes() const { return size_t(vertices) * sizeof(Vertex); }
+};
+
+// A mesh that pump() has finished uploading
+struct LoadedMesh {
+    int         tag;               // as given to load()
+    VertexBlock block;             // of the loader's VertexPool
+    int         vertices;
+    vec3        boundsMin, boundsMax;
+    float       radius;
+};
+
+class MeshLoader {
+   public:
+    // Fills a MeshData, allocating from the arena; false if there is
+    // nothing to load
+    typedef std::function<bool( MeshData&, StagingArena& )> Parser;
+
+    explicit MeshLoader( VertexPool& pool ) : _pool( pool ), _loading( 0 ), _uploaded( 0 )
+	{ _block.buffer = 0; }
+
+    // Run "parse" in the background; "tag" identifies the result
+    void load( int tag, Parser parse );
+
+    // GL thread: upload at most "budget" bytes.  True when that completed
+    // a mesh, which is then in "done".
+    bool pump( size_t budget, LoadedMesh& done );
+
+    // Anything still being parsed or uploaded
+    bool busy() const { return _loading > 0 || _current != nullptr; }
+
+   private:
+    typedef std::unique_ptr<StagingArena> Arena;
+
+    struct Finished {
+	int      tag;
+	MeshData mesh;
+	Arena    arena;   // holds the mesh
+    };
+
+    Arena takeArena();
+    void  giveArena( Arena arena );
+
+    VertexPool&          _pool;
+    std::atomic<int>     _loading;    // loads not yet taken off the queue
+    std::mutex           _lock;       // guards _finished and _spare
+    std::deque<Finished> _finished;   // completion queue
+    std::vector<Arena>   _spare;
+
+    // The mesh being uploaded
+    std::unique_ptr<Finished> _current;
+    VertexBlock               _block;
+    size_t                    _uploaded;   // bytes
+};
+
+#endif // __MESHLOADER_H__
@@ -0,0 +1,146 @@
+#include <string.h>
+#include "RenderQueue.h"
+#include "GLState.h"
+
+unsigned long long
+RenderQueue::makeKey(unsigned pass, unsigned subpass, GLuint program,
+		     GLuint texture, int material, GLfloat depth, bool backToFront)
+{
+    // Non-negative IEEE floats sort like unsigned integers; clamp so
+    // objects behind the eye don't wrap around to the far end
+    if ( !(depth > 0.0f) ) { depth = 0.0f; }
+    unsigned bits;
+    memcpy( &bits, &depth, sizeof(bits) );
+    if ( backToFront ) { bits = ~bits; }
+
+    return (unsigned long long)(pass & 0xF) << 60 |
+	   (unsigned long long)(subpass & 0x3) << 58 |
+	   (unsigned long long)(program & 0xFF) << 50 |
+	   (unsigned long long)(texture & 0xFF) << 42 |
+	   (unsigned long long)(material & 0x3FF) << 32 |
+	   bits;
+}
+
+void
+RenderQueue::clear()
+{
+    _calls.clear();
+    _keys.clear();
+    _order.clear();
+}
+
+void
+RenderQueue::submit(unsigned long long key, const DrawCall& call)
+{
+    _keys.push_back( key );
+    _calls.push_back( call );
+}
+
+// LSD radix sort of the indices, one byte per pass.  Bytes that are the
+// same in every key (most of the pass/program bits in practice) are
+// skipped, and the sort is stable so equal keys keep submission order.
+void
+RenderQueue::sort()
+{
+    unsigned n = _keys.size();
+    _order.resize( n );
+    _scratch.resize( n );
+    for ( unsigned i = 0; i < n; ++i ) _order[i] = i;
+
+    for ( int shift = 0; shift < 64; shift += 8 ) {
+	unsigned count[256] = { 0 };
+	for ( unsigned i = 0; i < n; ++i )
+	    ++count[(_keys[i] >> shift) & 0xFF];
+	if ( n == 0 || count[(_keys[0] >> shift) & 0xFF] == n )
+	    continue;
+
+	unsigned sum = 0;
+	for ( int b = 0; b < 256; ++b ) {
+	    unsigned c = count[b];
+	    count[b] = sum;
+	    sum += c;
+	}
+	for ( unsigned i = 0; i < n; ++i ) {
+	    unsigned idx = _order[i];
+	    _scratch[count[(_keys[idx] >> shift) & 0xFF]++] = idx;
+	}
+	_order.swap( _scratch );
+    }
+}
+
+static bool
+sameTarget(const RenderTarget& a, const RenderTarget& b)
+{
+    return a.framebuffer == b.framebuffer && a.x == b.x && a.y == b.y &&
+	   a.width == b.width && a.height == b.height;
+}
+
+static void
+bindTarget(const RenderTarget& target)
+{
+    glState.bindFramebuffer( target.framebuffer );
+    glState.viewport( target.x, target.y, target.width, target.height );
+}
+
+void
+RenderQueue::clearTarget(const RenderTarget& target)
+{
+    bindTarget( target );
+    if ( target.clear == 0 ) { return; }
+
+    // glClear honours the write masks
+    if ( target.clear & GL_COLOR_BUFFER_BIT )
+	glState.colorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+    if ( target.clear & GL_DEPTH_BUFFER_BIT )
+	glState.depthMask( GL_TRUE );
+    glClear( target.clear );
+}
+
+// Whether b can go into the same batch() call as a
+static bool
+sameBatch(const DrawCall& a, const DrawCall& b)
+{
+    return a.batch != NULL && a.batch == b.batch && a.instances == 0 && b.instances == 0 &&
+	   a.program == b.program && a.texture == b.texture &&
+	   a.polygonMode == b.polygonMode && a.blend == b.blend &&
+	   a.depthTest == b.depthTest && a.depthWrite == b.depthWrite &&
+	   a.colorWrite == b.colorWrite && a.mode == b.mode && a.obj->id == b.obj->id;
+}
+
+void
+RenderQueue::execute() const
+{
+    const RenderTarget* target = NULL;
+
+    for ( unsigned i = 0; i < _order.size(); ++i ) {
+	const DrawCall& call = _calls[_order[i]];
+	unsigned pass = unsigned(_keys[_order[i]] >> 60);
+
+	const RenderTarget& next = _targets[pass];
+	if ( target == NULL || !sameTarget( *target, next ) ) {
+	    target = &next;
+	    bindTarget( next );
+	}
+
+	glState.useProgram( call.program );
+	if ( call.texture != 0 )
+	    glState.bindTexture( GL_TEXTURE_2D, call.texture );
+	glState.polygonMode( call.polygonMode );
+	glState.enable( GL_BLEND, call.blend != GL_FALSE );
+	glState.enable( GL_DEPTH_TEST, call.depthTest != GL_FALSE );
+	glState.depthMask( call.depthWrite );
+	glState.colorMask( call.colorWrite, call.colorWrite,
+			   call.colorWrite, call.colorWrite );
+
+	// Merge the following draws of the same (sub)pass that fit the batch
+	unsigned position = unsigned(_keys[_order[i]] >> 58);  // pass and subpass
+	_run.clear();
+	_run.push_back( &call );
+	while ( i + 1 < _order.size() && unsigned(_keys[_order[i + 1]] >> 58) == position &&
+		sameBatch( call, _calls[_order[i + 1]] ) )
+	    _run.push_back( &_calls[_order[++i]] );
+
+	if ( _run.size() > 1 ) { call.batch( &_run[0], int(_run.size()) ); }
+	else                   { call.draw( call ); }
+    }
+}
@@ -0,0 +1,102 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- RenderQueue.h ---
+//
+//   Draws are submitted in any order together with a 64-bit sort key and
+//   executed after a radix sort on that key.  The key puts the pass slot
+//   and the subpass within it (passes merged by the FrameGraph share a
+//   slot) in the top bits, so the pass sequence is kept, and then groups
+//   draws by program, texture and material so the state cache sees as few
+//   changes as possible.  The low 32 bits are view depth (front to back, or back to
+//   front for blended passes).
+//
+//   Each pass slot has a RenderTarget; execute() binds it whenever the
+//   next draw goes to a different target.  Clearing is not tied to draws:
+//   the caller clears every target of the frame with clearTarget() up
+//   front, so a target that gets no draws is still cleared.
+//
+//   Draws with a "batch" callback are merged: a run of consecutive draws
+//   (in sorted order) that need the same state, primitive type and vertex
+//   buffer and are not instanced goes to one batch() call, which can
+//   issue them all at once (see drawMeshes() in main.cpp).  Their switches
+//   may differ; batch() gets them per draw.
+//
+//   bits 63..60  pass
+//        59..58  subpass
+//        57..50  program
+//        49..42  texture
+//        41..32  material
+//        31..0   depth
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __RENDERQUEUE_H__
+#define __RENDERQUEUE_H__
+
+#include <vector>
+#include "main.h"
+
+struct DrawCall;
+typedef void (*DrawFunc)( const DrawCall& call );
+typedef void (*BatchFunc)( const DrawCall* const* calls, int count );
+
+// Everything needed to issue one draw; the queue applies the GL state
+// through glState and leaves uniforms and the draw itself to "draw"
+struct DrawCall {
+    GLuint     program;
+    GLuint     texture;       // GL_TEXTURE_2D binding, 0 leaves it alone
+    GLenum     polygonMode;
+    GLboolean  blend;
+    GLboolean  depthTest;
+    GLboolean  depthWrite;
+    GLboolean  colorWrite;
+    int        switches;      // shader feature bits, meaning is up to "draw"
+    const ObjBuffer* obj;
+    GLenum     mode;          // primitive type
+    mat4       model;
+    GLsizei    instances;     // > 0: one instanced draw, model times each instance's
+    DrawFunc   draw;
+    BatchFunc  batch;         // null: never merged, see above
+};
+
+// Framebuffer and viewport a pass draws into
+struct RenderTarget {
+    GLuint     framebuffer;   // 0: the window
+    GLint      x, y;
+    GLsizei    width, height;
+    GLbitfield clear;         // buffers clearTarget() clears
+};
+
+class RenderQueue {
+   public:
+    RenderQueue() : _targets() {}
+
+    static unsigned long long makeKey( unsigned pass, unsigned subpass,
+				       GLuint program, GLuint texture, int material,
+				       GLfloat depth, bool backToFront = false );
+
+    enum { MaxPasses = 16 };
+
+    // Target of the draws keyed with "pass"; kept across clear()
+    void setTarget( unsigned pass, const RenderTarget& target )
+	{ _targets[pass & 0xF] = target; }
+
+    // Bind "target" and clear its "clear" buffers
+    static void clearTarget( const RenderTarget& target );
+
+    void clear();
+    void submit( unsigned long long key, const DrawCall& call );
+    void sort();
+    void execute() const;
+
+    size_t size() const { return _calls.size(); }
+
+   private:
+    std::vector<DrawCall>           _calls;
+    std::vector<unsigned long long> _keys;
+    std::vector<unsigned>           _order, _scratch;  // sorted indices
+    RenderTarget                    _targets[MaxPasses];
+    mutable std::vector<const DrawCall*> _run;         // execute()'s current batch
+};
+
+#endif // __RENDERQUEUE_H__
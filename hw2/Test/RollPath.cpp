@@ -0,0 +1,62 @@
+#include <algorithm>
+#include "RollPath.h"
+
+// Rolling along delta turns the ball about up x delta, by the distance
+// over the radius (radians)
+static quat
+roll(const vec3& axis, GLfloat distance, GLfloat radius)
+{
+    return RotateQuat( distance / radius * 180.0 / M_PI, axis.x, axis.y, axis.z );
+}
+
+RollPath::RollPath(const vec3* points, int count, GLfloat radius)
+    : _points( points, points + count ), _radius( radius )
+{
+    _start.push_back( 0.0 );
+    _rotation.push_back( quat() );
+    for ( int i = 0; i < count; ++i ) {
+	vec3 delta = points[(i + 1) % count] - points[i];
+	GLfloat distance = length( delta );
+
+	_axes.push_back( cross( vec3( 0.0, 1.0, 0.0 ), delta ) );
+	_start.push_back( _start.back() + distance );
+	_rotation.push_back( normalize( roll( _axes.back(), distance, radius ) *
+					_rotation.back() ) );
+    }
+}
+
+void
+RollPath::evaluate(GLfloat s, vec3& center, quat& orientation) const
+{
+    GLfloat lap = lapLength();
+    if ( _points.empty() || lap <= 0.0 ) {
+	center = _points.empty() ? vec3( 0.0 ) : _points[0];
+	orientation = quat();
+	return;
+    }
+
+    // Whole laps, then the segment containing the rest: the last one
+    // starting at or before it
+    GLfloat laps = floorf( s / lap );
+    GLfloat rest = std::min( std::max( s - laps * lap, GLfloat(0.0) ), lap );
+    int i = int( std::upper_bound( _start.begin(), _start.end() - 1, rest ) -
+		 _start.begin() ) - 1;
+
+    GLfloat along = rest - _start[i];
+    GLfloat segment = _start[i + 1] - _start[i];
+    const vec3& a = _points[i];
+    const vec3& b = _points[(i + 1) % _points.size()];
+
+    center = segment > 0.0 ? a + (b - a) * (along / segment) : a;
+    orientation = normalize( roll( _axes[i], along, _radius ) * _rotation[i] *
+			     pow( _rotation.back(), laps ) );
+}
+
+affine
+RollPath::transform(GLfloat s) const
+{
+    vec3 center;
+    quat orientation;
+    evaluate( s, center, orientation );
+    return Translate( center ) * Rotate( orientation );
+}
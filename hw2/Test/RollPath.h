@@ -0,0 +1,46 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- RollPath.h ---
+//
+//   A ball of a given radius rolling without slipping around a closed
+//   loop of keyframe points.  The constructor precomputes the arc length
+//   at the start of every segment and the orientation the ball has
+//   accumulated there, so evaluating any distance is a binary search plus
+//   one partial roll; whole laps are one quaternion power.
+//
+//   A RollPath is immutable once built: evaluation has no hidden state,
+//   distances may jump or go backwards, and any number of paths (or
+//   balls on one path) can be evaluated independently.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ROLLPATH_H__
+#define __ROLLPATH_H__
+
+#include <vector>
+#include "Angel-yjc.h"
+
+class RollPath {
+   public:
+    // The loop through points[0], ..., points[count - 1] and back to
+    // points[0]; the points are where the ball's center passes
+    RollPath( const vec3* points, int count, GLfloat radius = 1.0 );
+
+    GLfloat lapLength() const { return _start.back(); }
+    GLfloat radius() const { return _radius; }
+
+    // Center and orientation after rolling distance s from points[0]
+    void evaluate( GLfloat s, vec3& center, quat& orientation ) const;
+
+    // The ball's model transform after rolling distance s
+    affine transform( GLfloat s ) const;
+
+   private:
+    std::vector<vec3>    _points;
+    std::vector<vec3>    _axes;      // roll axis of each segment
+    std::vector<GLfloat> _start;     // arc length where each segment starts, plus the lap length
+    std::vector<quat>    _rotation;  // orientation where each segment starts, plus one lap's
+    GLfloat              _radius;
+};
+
+#endif // __ROLLPATH_H__
@@ -0,0 +1,107 @@
+#include <algorithm>
+#include "Scene.h"
+#include "JobSystem.h"
+
+// Entities per job below which splitting costs more than it saves
+static const size_t ParallelMin = 512;
+
+Scene::Entity
+Scene::create(const ObjBuffer& obj, GLenum primitive, int renderPass,
+	      GLuint shader, DrawFunc drawFunc, Entity parent)
+{
+    transforms.add( parent );
+    model.push_back( mat4( 1.0 ) );
+    mesh.push_back( &obj );
+    mode.push_back( primitive );
+    instances.push_back( 0 );
+    pass.push_back( renderPass );
+    program.push_back( shader );
+    draw.push_back( drawFunc );
+    batch.push_back( NULL );
+    texture.push_back( 0 );
+    switches.push_back( 0 );
+    polygonMode.push_back( GL_FILL );
+    flags.push_back( ENTITY_VISIBLE );
+    localMin.push_back( obj.boundsMin );
+    localMax.push_back( obj.boundsMax );
+    worldMin.push_back( obj.boundsMin );
+    worldMax.push_back( obj.boundsMax );
+    _rebuild = true;
+    return Entity( mesh.size() - 1 );
+}
+
+void
+Scene::setLocalBounds(Entity e, const vec3& lo, const vec3& hi)
+{
+    localMin[e] = lo;
+    localMax[e] = hi;
+    updateBounds( e );
+    _moved.push_back( e );
+}
+
+void
+Scene::updateTransforms()
+{
+    transforms.update();
+
+    // Every entity's entries are its own, so the moved ones can be
+    // refreshed in parallel
+    const std::vector<TransformTree::Node>& moved = transforms.updated();
+    jobSystem.parallelFor( moved.size(), jobSystem.chunkSize( moved.size(), ParallelMin ),
+			   [&]( size_t b, size_t e, unsigned ) {
+	for ( size_t i = b; i < e; ++i ) {
+	    model[moved[i]] = transforms.world( moved[i] );
+	    updateBounds( moved[i] );
+	}
+    } );
+    _moved.insert( _moved.end(), moved.begin(), moved.end() );
+}
+
+void
+Scene::updateBounds()
+{
+    jobSystem.parallelFor( size(), jobSystem.chunkSize( size(), ParallelMin ),
+			   [&]( size_t b, size_t e, unsigned ) {
+	for ( size_t i = b; i < e; ++i )
+	    updateBounds( Entity(i) );
+    } );
+    _rebuild = true;
+}
+
+void
+Scene::updateTree()
+{
+    if ( !_rebuild && !_moved.empty() ) {
+	_tree.refit( _moved, worldMin, worldMax );
+	_rebuild = _tree.needsRebuild();
+    }
+    if ( _rebuild ) { _tree.build( worldMin, worldMax ); }
+    _moved.clear();
+    _rebuild = false;
+}
+
+void
+Scene::cull(const ViewFrustum& f, std::vector<Entity>& entities)
+{
+    updateTree();
+    size_t first = entities.size();
+    _tree.cull( f, worldMin, worldMax, entities );
+    std::sort( entities.begin() + first, entities.end() );
+}
+
+void
+Scene::updateBounds(Entity i)
+{
+    // Center and half extent: the world half extent along each axis is
+    // the absolute 3x3 part of the transform times the local one
+    const mat4& m = model[i];
+    vec3 c = (localMin[i] + localMax[i]) * 0.5;
+    vec3 e = (localMax[i] - localMin[i]) * 0.5;
+    vec3 wc, we;
+    for ( int r = 0; r < 3; ++r ) {
+	wc[r] = m[r][0] * c.x + m[r][1] * c.y + m[r][2] * c.z + m[r][3];
+	we[r] = fabs( m[r][0] ) * e.x + fabs( m[r][1] ) * e.y + fabs( m[r][2] ) * e.z;
+    }
+    worldMin[i] = wc - we;
+    worldMax[i] = wc + we;
+}
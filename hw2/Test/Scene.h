@@ -0,0 +1,108 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- Scene.h ---
+//
+//   Entity store.  An entity is an index; its components live in parallel
+//   arrays (structure of arrays), one entry per entity, so a system that
+//   needs only transforms and bounds streams through just those arrays.
+//   Adding an object to the scene is one create() and a few component
+//   writes, not new globals and new code in display().
+//
+//   Components:
+//     transform   node of "transforms" (node i is entity i), relative to
+//                 a parent entity; "model" caches its world transform
+//     mesh        ObjBuffer, primitive type, instance count
+//     material    program, draw and batch callbacks, texture, shader
+//                 switches, polygon mode
+//     flags       EntityFlag bits
+//     bounds      object-space box (mesh bounds, or all instances) and
+//                 the world-space box derived from it
+//
+//   updateTransforms() refreshes "model" and the world boxes of just the
+//   entities that moved (or whose parents did) since the last call.
+//   Both bounds systems split their loops over the job system.
+//
+//   cull() finds the entities whose world boxes reach into a view volume
+//   through a BVH over those boxes.  The tree is refit with just the
+//   boxes that changed since the last cull(), and built again when
+//   entities were added or refitting has made it too loose.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __SCENE_H__
+#define __SCENE_H__
+
+#include <vector>
+#include "BVH.h"
+#include "RenderQueue.h"
+#include "TransformTree.h"
+#include "ViewFrustum.h"
+
+enum EntityFlag {
+    ENTITY_VISIBLE  = 1,
+    ENTITY_CASTER   = 2,   // drawn into the shadow map
+    ENTITY_RECEIVER = 4    // looks up the shadow map
+};
+
+class Scene {
+   public:
+    typedef int Entity;
+    enum { NoParent = TransformTree::Root };
+
+    // A visible entity drawing "mesh" into "pass"; everything else starts
+    // as a default DrawCall would.  Its transform is relative to "parent".
+    Entity create( const ObjBuffer& mesh, GLenum mode, int pass,
+		   GLuint program, DrawFunc draw, Entity parent = NoParent );
+
+    Scene() : _rebuild(true) {}
+
+    size_t size() const { return mesh.size(); }
+
+    void setTransform( Entity e, const affine& local )
+	{ transforms.setLocal( e, local ); }
+    void setLocalBounds( Entity e, const vec3& lo, const vec3& hi );
+
+    // System: world transforms and bounds of the entities that moved
+    void updateTransforms();
+
+    // System: world-space bounds of every entity
+    void updateBounds();
+
+    // System: the entities whose world boxes are not outside f, visible
+    // or not, in entity order, into "entities"
+    void cull( const ViewFrustum& f, std::vector<Entity>& entities );
+
+    // Transform
+    TransformTree                 transforms;
+    std::vector<mat4>             model;        // world, as of updateTransforms()
+
+    // Mesh
+    std::vector<const ObjBuffer*> mesh;
+    std::vector<GLenum>           mode;         // primitive type
+    std::vector<GLsizei>          instances;    // > 0: instanced, see DrawCall
+
+    // Material
+    std::vector<int>              pass;
+    std::vector<GLuint>           program;
+    std::vector<DrawFunc>         draw;
+    std::vector<BatchFunc>        batch;        // null: never batched, see DrawCall
+    std::vector<GLuint>           texture;      // 0: none
+    std::vector<int>              switches;     // shader feature bits
+    std::vector<GLenum>           polygonMode;
+
+    std::vector<unsigned>         flags;        // EntityFlag bits
+
+    // Bounds
+    std::vector<vec3>             localMin, localMax;
+    std::vector<vec3>             worldMin, worldMax;
+
+   private:
+    void updateBounds( Entity e );
+    void updateTree();
+
+    BVH                 _tree;     // over worldMin, worldMax
+    std::vector<Entity> _moved;    // world boxes changed since updateTree()
+    bool                _rebuild;  // all of them did
+};
+
+#endif // __SCENE_H__
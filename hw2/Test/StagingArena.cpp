@@ -0,0 +1,52 @@
+#include <stdint.h>
+#include "StagingArena.h"
+
+StagingArena::Block
+StagingArena::newBlock(size_t size, size_t align)
+{
+    Block b;
+    b.memory.reset( new char[size + align - 1] );
+    uintptr_t base = uintptr_t( b.memory.get() );
+    b.data = (char*) ((base + align - 1) & ~uintptr_t( align - 1 ));
+    b.size = size;
+    return b;
+}
+
+void*
+StagingArena::allocate(size_t bytes, size_t align)
+{
+    if ( align < BlockAlign ) { align = BlockAlign; }
+
+    if ( !_blocks.empty() ) {
+	Block& b = _blocks.back();
+	uintptr_t base = uintptr_t( b.data );
+	size_t start = size_t( ((base + _offset + align - 1) & ~uintptr_t( align - 1 )) - base );
+	if ( start + bytes <= b.size ) {
+	    _offset = start + bytes;
+	    return b.data + start;
+	}
+    }
+
+    _blocks.push_back( newBlock( bytes > _blockSize ? bytes : _blockSize, align ) );
+    _offset = bytes;
+    return _blocks.back().data;
+}
+
+void
+StagingArena::reset()
+{
+    if ( _blocks.size() > 1 ) {
+	size_t size = capacity();
+	_blocks.clear();            // free the old ones before the big one
+	_blocks.push_back( newBlock( size, BlockAlign ) );
+    }
+    _offset = 0;
+}
+
+size_t
+StagingArena::capacity() const
+{
+    size_t total = 0;
+    for ( size_t i = 0; i < _blocks.size(); ++i ) total += _blocks[i].size;
+    return total;
+}
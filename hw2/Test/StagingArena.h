@@ -0,0 +1,56 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- StagingArena.h ---
+//
+//   Scratch memory for one load at a time.  allocate() just bumps an
+//   offset, and nothing is freed one allocation at a time: reset() drops
+//   everything at once and keeps the memory for the next load.  If a load
+//   needed more than one block, reset() replaces them with one block of
+//   their total size, so a loader that keeps reusing its arena soon
+//   stops calling the heap.
+//
+//   Blocks start at BlockAlign bytes (new[] alone only promises 8 on
+//   Win32, too little for the alignas(16) vec4 in a Vertex), and every
+//   allocation starts at a multiple of its alignment, at least BlockAlign.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __STAGINGARENA_H__
+#define __STAGINGARENA_H__
+
+#include <memory>
+#include <stddef.h>
+#include <vector>
+
+class StagingArena {
+   public:
+    enum { BlockAlign = 16 };
+
+    explicit StagingArena( size_t blockSize = 1 << 20 )
+	: _blockSize( blockSize ), _offset( 0 ) {}
+
+    // Uninitialized, "align" must be a power of 2
+    void* allocate( size_t bytes, size_t align = BlockAlign );
+
+    template <class T>
+    T* allocate( size_t n ) { return (T*) allocate( n * sizeof(T), alignof(T) ); }
+
+    void reset();
+
+    size_t capacity() const;
+
+   private:
+    struct Block {
+	std::unique_ptr<char[]> memory;   // as allocated, "align" - 1 bytes more
+	char*                   data;     // aligned start of the usable "size" bytes
+	size_t                  size;
+    };
+
+    static Block newBlock( size_t size, size_t align );
+
+    size_t             _blockSize;
+    std::vector<Block> _blocks;    // the last one is being filled
+    size_t             _offset;    // in the last block
+};
+
+#endif // __STAGINGARENA_H__
@@ -0,0 +1,62 @@
+#include <algorithm>
+#include <functional>
+#include "TransformTree.h"
+
+TransformTree::Node
+TransformTree::add(Node parent, const affine& local)
+{
+    Node n = Node( _parent.size() );
+    _parent.push_back( parent );
+    _firstChild.push_back( -1 );
+    _nextSibling.push_back( -1 );
+    if ( parent != Root ) {
+	_nextSibling[n] = _firstChild[parent];
+	_firstChild[parent] = n;
+    }
+    _local.push_back( local );
+    _world.push_back( local );
+    _normal.push_back( mat3() );
+    _dirty.push_back( false );
+    markDirty( n );
+    return n;
+}
+
+void
+TransformTree::setLocal(Node n, const affine& local)
+{
+    _local[n] = local;
+    markDirty( n );
+}
+
+void
+TransformTree::markDirty(Node n)
+{
+    if ( _dirty[n] ) { return; }
+    _dirty[n] = true;
+    _pending.push_back( n );
+    std::push_heap( _pending.begin(), _pending.end(), std::greater<Node>() );
+}
+
+void
+TransformTree::update()
+{
+    _updated.clear();
+
+    // Children have larger indices than their parent, so taking the
+    // smallest dirty index each time sees every parent first.  A child
+    // that was dirty already is queued once.
+    while ( !_pending.empty() ) {
+	std::pop_heap( _pending.begin(), _pending.end(), std::greater<Node>() );
+	Node n = _pending.back();
+	_pending.pop_back();
+
+	Node p = _parent[n];
+	_world[n] = p == Root ? _local[n] : _world[p] * _local[n];
+	_normal[n] = NormalMatrix( _world[n] );
+	_dirty[n] = false;
+	_updated.push_back( n );
+
+	for ( Node c = _firstChild[n]; c != -1; c = _nextSibling[c] )
+	    markDirty( c );
+    }
+}
@@ -0,0 +1,58 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- TransformTree.h ---
+//
+//   Parent/child transform hierarchy with cached matrices.  Every node
+//   keeps its local transform, its world transform (parent world * local)
+//   and the normal matrix of the world transform.  Nodes live in one
+//   flat array; a parent is always added before its children, so its
+//   index is smaller.
+//
+//   setLocal() only marks the node dirty.  update() recomputes the dirty
+//   nodes and their descendants, smallest index first so every parent is
+//   current before its children, and leaves everything else alone: the
+//   cost follows what moved, not how big the tree is.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __TRANSFORMTREE_H__
+#define __TRANSFORMTREE_H__
+
+#include <vector>
+#include "Angel-yjc.h"
+
+class TransformTree {
+   public:
+    typedef int Node;
+    enum { Root = -1 };   // parent of the top-level nodes
+
+    Node add( Node parent, const affine& local = affine() );
+
+    void setLocal( Node n, const affine& local );
+
+    const affine& local( Node n ) const { return _local[n]; }
+    const affine& world( Node n ) const { return _world[n]; }
+    const mat3&   normal( Node n ) const { return _normal[n]; }
+    Node          parent( Node n ) const { return _parent[n]; }
+
+    int size() const { return int(_parent.size()); }
+
+    // Bring every dirty node and its descendants up to date
+    void update();
+
+    // Nodes recomputed by the last update(), in index order
+    const std::vector<Node>& updated() const { return _updated; }
+
+   private:
+    void markDirty( Node n );
+
+    std::vector<Node>   _parent;
+    std::vector<Node>   _firstChild, _nextSibling;  // -1: none
+    std::vector<affine> _local, _world;
+    std::vector<mat3>   _normal;
+    std::vector<bool>   _dirty;
+    std::vector<Node>   _pending;   // min-heap of the dirty nodes
+    std::vector<Node>   _updated;
+};
+
+#endif // __TRANSFORMTREE_H__
@@ -0,0 +1,52 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- TripleBuffer.h ---
+//
+//   Hands whole values from one writer thread to one reader thread
+//   without locks and without either side ever waiting.  Of the three
+//   slots, the writer owns one (back), the reader owns one (front) and
+//   the third (middle) holds the latest published value.  publish() and
+//   update() swap their slot with the middle one in a single atomic
+//   exchange; a flag in the exchanged word tells the reader whether the
+//   middle slot is newer than what it has.
+//
+//   The writer fills back() completely before publish(), so the reader
+//   only ever sees complete values.  Slots are reused: back() still holds
+//   whatever was written into it two publishes ago.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __TRIPLEBUFFER_H__
+#define __TRIPLEBUFFER_H__
+
+#include <atomic>
+
+template <class T>
+class TripleBuffer {
+   public:
+    TripleBuffer() : _back(0), _middle(1), _front(2) {}
+
+    // Writer side
+    T& back() { return _slots[_back]; }
+    void publish()
+	{ _back = _middle.exchange( _back | Fresh, std::memory_order_acq_rel ) & Index; }
+
+    // Reader side: take the latest published value, if there is a newer
+    // one than front(); true if front() changed
+    bool update() {
+	if ( !(_middle.load( std::memory_order_relaxed ) & Fresh) ) { return false; }
+	_front = _middle.exchange( _front, std::memory_order_acq_rel ) & Index;
+	return true;
+    }
+    const T& front() const { return _slots[_front]; }
+
+   private:
+    enum { Index = 3, Fresh = 4 };
+
+    T                     _slots[3];
+    unsigned              _back;     // writer's
+    std::atomic<unsigned> _middle;   // slot index | Fresh
+    unsigned              _front;    // reader's
+};
+
+#endif // __TRIPLEBUFFER_H__
@@ -0,0 +1,74 @@
+#include "VertexPool.h"
+
+VertexBlock
+VertexPool::allocate(GLsizeiptr bytes)
+{
+    GLsizeiptr size = round( bytes > 0 ? bytes : 1 );
+
+    for ( size_t p = 0; p < _pages.size(); ++p ) {
+	std::vector<Range>& free = _pages[p].free;
+	for ( size_t r = 0; r < free.size(); ++r ) {
+	    if ( free[r].size < size ) { continue; }
+	    VertexBlock block = { _pages[p].buffer, free[r].offset, size };
+	    free[r].offset += size;
+	    free[r].size -= size;
+	    if ( free[r].size == 0 ) { free.erase( free.begin() + r ); }
+	    return block;
+	}
+    }
+
+    // No room: a new page, big enough for this block
+    Page page;
+    page.buffer = GLBuffer::create();
+    page.size = size > _pageSize ? size : _pageSize;
+    glState.bindBuffer( GL_ARRAY_BUFFER, page.buffer );
+    glBufferData( GL_ARRAY_BUFFER, page.size, NULL, _usage );
+    if ( page.size > size ) {
+	Range rest = { size, page.size - size };
+	page.free.push_back( rest );
+    }
+    VertexBlock block = { page.buffer, 0, size };
+    _pages.push_back( std::move( page ) );
+    return block;
+}
+
+void
+VertexPool::free(const VertexBlock& block)
+{
+    if ( block.buffer == 0 ) { return; }
+    size_t p = 0;
+    while ( p < _pages.size() && _pages[p].buffer != block.buffer ) { ++p; }
+    if ( p == _pages.size() ) { return; }   // not ours, or cleared
+
+    Page& page = _pages[p];
+    std::vector<Range>& free = page.free;
+    Range range = { block.offset, round( block.size ) };
+
+    // Insert by offset, then merge with the neighbours it touches
+    size_t r = 0;
+    while ( r < free.size() && free[r].offset < range.offset ) { ++r; }
+    free.insert( free.begin() + r, range );
+    if ( r + 1 < free.size() && free[r].offset + free[r].size == free[r + 1].offset ) {
+	free[r].size += free[r + 1].size;
+	free.erase( free.begin() + r + 1 );
+    }
+    if ( r > 0 && free[r - 1].offset + free[r - 1].size == free[r].offset ) {
+	free[r - 1].size += free[r].size;
+	free.erase( free.begin() + r );
+    }
+
+    bool empty = free.size() == 1 && free[0].size == page.size;
+    if ( empty && p > 0 ) { _pages.erase( _pages.begin() + p ); }
+}
+
+GLsizeiptr
+VertexPool::allocated() const
+{
+    GLsizeiptr total = 0;
+    for ( size_t p = 0; p < _pages.size(); ++p ) {
+	total += _pages[p].size;
+	for ( size_t r = 0; r < _pages[p].free.size(); ++r )
+	    total -= _pages[p].free[r].size;
+    }
+    return total;
+}
@@ -0,0 +1,68 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- VertexPool.h ---
+//
+//   Suballocator for vertex data.  Meshes get blocks of a few large GL
+//   buffers ("pages") instead of one buffer each, so consecutive draws
+//   mostly keep the same buffer bound.  Each page keeps a list of its
+//   free ranges, sorted by offset; allocate() takes the first range that
+//   fits and free() merges a range back with its free neighbours.  A page
+//   that becomes empty is deleted, except the first, so memory follows
+//   what is loaded.  Meshes larger than a page get a page of their own.
+//   Blocks start at multiples of "align" (the vertex size, for meshes
+//   drawn as ranges of one vertex array).
+//
+//   GL thread only.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __VERTEXPOOL_H__
+#define __VERTEXPOOL_H__
+
+#include <vector>
+#include "GLHandle.h"
+
+struct VertexBlock {
+    GLuint     buffer;    // 0: none
+    GLintptr   offset;    // bytes
+    GLsizeiptr size;
+};
+
+class VertexPool {
+   public:
+    explicit VertexPool( GLsizeiptr pageSize = 4 << 20, GLenum usage = GL_STATIC_DRAW,
+			 GLsizeiptr align = 64 )
+	: _pageSize( pageSize ), _usage( usage ), _align( align ) {}
+
+    // A block of at least "bytes" bytes
+    VertexBlock allocate( GLsizeiptr bytes );
+
+    void free( const VertexBlock& block );
+
+    // Delete every page; outstanding blocks become invalid
+    void clear() { _pages.clear(); }
+
+    int        pages() const { return int(_pages.size()); }
+    GLsizeiptr allocated() const;   // bytes in blocks
+
+   private:
+    struct Range {
+	GLintptr   offset;
+	GLsizeiptr size;
+    };
+
+    struct Page {
+	GLBuffer           buffer;
+	GLsizeiptr         size;
+	std::vector<Range> free;   // by offset, never adjacent
+    };
+
+    GLsizeiptr round( GLsizeiptr bytes ) const { return (bytes + _align - 1) / _align * _align; }
+
+    GLsizeiptr        _pageSize;
+    GLenum            _usage;
+    GLsizeiptr        _align;
+    std::vector<Page> _pages;
+};
+
+#endif // __VERTEXPOOL_H__
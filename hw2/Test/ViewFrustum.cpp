@@ -0,0 +1,106 @@
+#include <math.h>
+#include "ViewFrustum.h"
+
+// d of the padding planes: farther than anything tested is big
+static const float Everything = 1e30f;
+
+ViewFrustum::ViewFrustum()
+{
+    for ( int i = 0; i < Planes; ++i ) {
+	_a[i] = _b[i] = _c[i] = 0.0f;
+	_d[i] = Everything;
+    }
+}
+
+ViewFrustum::ViewFrustum(const mat4& clip)
+{
+    // Clip space is inside when -w <= x, y, z <= w, so each plane is the
+    // 4th row of the matrix plus or minus one of the others
+    // (Gribb & Hartmann)
+    for ( int i = 0; i < 6; ++i ) {
+	vec4 p = (i & 1) ? clip[3] - clip[i / 2] : clip[3] + clip[i / 2];
+	float s = 1.0f / sqrtf( p.x * p.x + p.y * p.y + p.z * p.z );
+	_a[i] = p.x * s;
+	_b[i] = p.y * s;
+	_c[i] = p.z * s;
+	_d[i] = p.w * s;
+    }
+    for ( int i = 6; i < Planes; ++i ) {
+	_a[i] = _b[i] = _c[i] = 0.0f;
+	_d[i] = Everything;
+    }
+}
+
+#ifdef ANGEL_SIMD_SSE
+
+// Planes a..d[0..3] against the box with center (x, y, z) and half
+// extent e, grown by "radius": the signed distances of the center against
+// the reach r of the volume towards each plane.  Sets outside bits where
+// the whole volume is behind a plane and straddling bits where part is.
+static inline void
+testPlanes(const float* a, const float* b, const float* c, const float* d,
+	   __m128 x, __m128 y, __m128 z, __m128 ex, __m128 ey, __m128 ez, __m128 radius,
+	   int& outside, int& straddling)
+{
+    const __m128 sign = _mm_set1_ps( -0.0f );
+    __m128 pa = _mm_load_ps( a ), pb = _mm_load_ps( b ), pc = _mm_load_ps( c );
+    __m128 dist = _mm_add_ps( _mm_add_ps( _mm_mul_ps( pa, x ), _mm_mul_ps( pb, y ) ),
+			      _mm_add_ps( _mm_mul_ps( pc, z ), _mm_load_ps( d ) ) );
+    __m128 r = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_andnot_ps( sign, pa ), ex ),
+				       _mm_mul_ps( _mm_andnot_ps( sign, pb ), ey ) ),
+			   _mm_add_ps( _mm_mul_ps( _mm_andnot_ps( sign, pc ), ez ), radius ) );
+    outside |= _mm_movemask_ps( _mm_cmplt_ps( dist, _mm_sub_ps( _mm_setzero_ps(), r ) ) );
+    straddling |= _mm_movemask_ps( _mm_cmplt_ps( dist, r ) );
+}
+
+#endif
+
+static inline ViewFrustum::Result
+classify(int outside, int straddling)
+{
+    return outside ? ViewFrustum::Outside : straddling ? ViewFrustum::Intersects : ViewFrustum::Inside;
+}
+
+ViewFrustum::Result
+ViewFrustum::testBox(const vec3& lo, const vec3& hi) const
+{
+    vec3 center = (lo + hi) * 0.5;
+    vec3 e = (hi - lo) * 0.5;
+    int outside = 0, straddling = 0;
+
+#ifdef ANGEL_SIMD_SSE
+    __m128 x = _mm_set1_ps( center.x ), y = _mm_set1_ps( center.y ), z = _mm_set1_ps( center.z );
+    __m128 ex = _mm_set1_ps( e.x ), ey = _mm_set1_ps( e.y ), ez = _mm_set1_ps( e.z );
+    __m128 zero = _mm_setzero_ps();
+    testPlanes( _a, _b, _c, _d, x, y, z, ex, ey, ez, zero, outside, straddling );
+    testPlanes( _a + 4, _b + 4, _c + 4, _d + 4, x, y, z, ex, ey, ez, zero, outside, straddling );
+#else
+    for ( int i = 0; i < 6; ++i ) {
+	float dist = _a[i] * center.x + _b[i] * center.y + _c[i] * center.z + _d[i];
+	float r = fabsf( _a[i] ) * e.x + fabsf( _b[i] ) * e.y + fabsf( _c[i] ) * e.z;
+	if ( dist < -r ) { outside = 1; }
+	if ( dist < r )  { straddling = 1; }
+    }
+#endif
+    return classify( outside, straddling );
+}
+
+ViewFrustum::Result
+ViewFrustum::testSphere(const vec3& center, float radius) const
+{
+    int outside = 0, straddling = 0;
+
+#ifdef ANGEL_SIMD_SSE
+    __m128 x = _mm_set1_ps( center.x ), y = _mm_set1_ps( center.y ), z = _mm_set1_ps( center.z );
+    __m128 zero = _mm_setzero_ps(), r = _mm_set1_ps( radius );
+    testPlanes( _a, _b, _c, _d, x, y, z, zero, zero, zero, r, outside, straddling );
+    testPlanes( _a + 4, _b + 4, _c + 4, _d + 4, x, y, z, zero, zero, zero, r, outside, straddling );
+#else
+    for ( int i = 0; i < 6; ++i ) {
+	float dist = _a[i] * center.x + _b[i] * center.y + _c[i] * center.z + _d[i];
+	if ( dist < -radius ) { outside = 1; }
+	if ( dist < radius )  { straddling = 1; }
+    }
+#endif
+    return classify( outside, straddling );
+}
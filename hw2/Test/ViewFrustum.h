@@ -0,0 +1,39 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- ViewFrustum.h ---
+//
+//   The six planes of a view volume, taken from its clip matrix
+//   (projection * view, e.g. Perspective(...) * LookAt(...)): a point p
+//   is inside when every plane gives a * p.x + b * p.y + c * p.z + d >= 0.
+//
+//   The planes are stored as structure of arrays, padded to eight with
+//   planes that accept everything, so with SSE one test handles four
+//   planes per instruction.  Boxes are tested by their center and half
+//   extent: a box is outside a plane when even its corner nearest the
+//   inside is behind it.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __VIEWFRUSTUM_H__
+#define __VIEWFRUSTUM_H__
+
+#include "Angel-yjc.h"
+
+class ViewFrustum {
+   public:
+    enum Result { Outside, Intersects, Inside };
+
+    ViewFrustum();                      // accepts everything
+    explicit ViewFrustum( const mat4& clip );
+
+    Result testBox( const vec3& lo, const vec3& hi ) const;
+    Result testSphere( const vec3& center, float radius ) const;
+
+   private:
+    enum { Planes = 8 };   // 6 real ones, then padding
+
+    // Planes i: a[i] x + b[i] y + c[i] z + d[i], normalized
+    alignas(16) float _a[Planes], _b[Planes], _c[Planes], _d[Planes];
+};
+
+#endif // __VIEWFRUSTUM_H__
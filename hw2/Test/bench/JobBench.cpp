@@ -0,0 +1,93 @@
+// Scaling of the job system with the number of threads.  Built only with
+// -DBUILD_BENCHMARKS=ON; run as JobBench [max threads] (default: all
+// hardware threads).  For each thread count it times
+//
+//   parallelFor   a fixed amount of arithmetic split into many chunks
+//   graph         fan-out/fan-in waves of small dependent jobs, which
+//                 mostly measures queueing and stealing overhead
+//
+// and prints the speedup over one thread.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include "../JobSystem.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double
+ms(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+}
+
+// Enough work per item that memory bandwidth does not dominate
+static float
+work(size_t i)
+{
+    float x = float( i % 1000 ) * 0.001f;
+    for ( int k = 0; k < 64; ++k ) { x = sqrtf( x * x + 1.0f ) - 0.5f; }
+    return x;
+}
+
+static double
+benchParallelFor(JobSystem& jobs, std::vector<float>& out)
+{
+    Clock::time_point start = Clock::now();
+    jobs.parallelFor( out.size(), jobs.chunkSize( out.size(), 1024 ),
+		      [&]( size_t b, size_t e, unsigned ) {
+	for ( size_t i = b; i < e; ++i ) out[i] = work( i );
+    } );
+    return ms( start );
+}
+
+static double
+benchGraph(JobSystem& jobs, int waves, int width)
+{
+    Clock::time_point start = Clock::now();
+    std::vector<JobSystem::Job> prev, cur;
+    std::vector<float> sink( width );
+    for ( int w = 0; w < waves; ++w ) {
+	JobSystem::Job join = jobs.run( []() {}, prev );
+	cur.clear();
+	for ( int i = 0; i < width; ++i )
+	    cur.push_back( jobs.run( [&sink, i]() { sink[i] += work( i ); },
+				     std::vector<JobSystem::Job>( 1, join ) ) );
+	prev.swap( cur );
+    }
+    for ( size_t i = 0; i < prev.size(); ++i ) jobs.wait( prev[i] );
+    return ms( start );
+}
+
+int
+main(int argc, char** argv)
+{
+    unsigned maxThreads = argc > 1 ? unsigned( atoi( argv[1] ) )
+				   : std::thread::hardware_concurrency();
+    if ( maxThreads < 1 ) { maxThreads = 1; }
+
+    std::vector<float> out( 1 << 22 );
+    double base[2] = { 0, 0 };
+    printf( "threads  parallelFor ms  speedup   graph ms  speedup\n" );
+    for ( unsigned threads = 1; threads <= maxThreads;
+	  threads = threads < maxThreads && threads * 2 > maxThreads ? maxThreads : threads * 2 ) {
+	JobSystem jobs;
+	if ( threads > 1 ) { jobs.start( threads - 1 ); }
+
+	// Best of three, after one warm-up run
+	double t[2] = { 1e30, 1e30 };
+	for ( int run = 0; run < 4; ++run ) {
+	    double a = benchParallelFor( jobs, out );
+	    double b = benchGraph( jobs, 200, 256 );
+	    if ( run == 0 ) { continue; }
+	    t[0] = fmin( t[0], a );
+	    t[1] = fmin( t[1], b );
+	}
+	if ( threads == 1 ) { base[0] = t[0]; base[1] = t[1]; }
+	printf( "%7u  %14.2f  %7.2f  %9.2f  %7.2f\n", threads,
+		t[0], base[0] / t[0], t[1], base[1] / t[1] );
+    }
+    return 0;
+}
@@ -7,11 +7,13 @@
 
 in vec4 color;
 in float dist;
+in vec4 lightcoord;
+flat in int drawSwitches;   // ShaderSwitch bits of main.cpp, see vshader42
 varying vec2 texcoord;
 varying vec2 latcoord;
 uniform sampler2D checkerTex;
 uniform sampler1D stripeTex;
-uniform bool floorTexture = true;
+uniform sampler2DShadow shadowMap;
 out vec4 fColor;
 
 uniform vec4 fogColor = vec4(0.7, 0.7, 0.7, 0.5);
@@ -20,11 +22,18 @@ uniform float fogend = 18.f;
 uniform float fogdensity = .09f;
 
 uniform int f_fog = 0;
-uniform int f_sphereTexture = 1;
-uniform bool f_lattice = false;
+
+const int SW_LATTICE = 4, SW_FLOOR_TEXTURE = 8, SW_SHADOW = 16;
+
+uniform vec4 shadow_color = vec4(.25, .25, .25, .65);  // alpha: shadow strength
+uniform float shadow_bias = .0005;
 
 void main() 
 { 
+	bool f_lattice = (drawSwitches & SW_LATTICE) != 0;
+	bool floorTexture = (drawSwitches & SW_FLOOR_TEXTURE) != 0;
+	int f_sphereTexture = (drawSwitches >> 5) & 3;
+
 	if (f_lattice && fract(4 * latcoord.x) < 0.35 && fract(4 * latcoord.y) < 0.35)
 		discard;
 	
@@ -48,5 +57,12 @@ void main()
 		fColor *= texc;
 	}
 
+	if ((drawSwitches & SW_SHADOW) != 0) {
+		// 2x2 filtered depth comparison: 1 lit, 0 in shadow
+		vec4 lc = vec4(lightcoord.xy, lightcoord.z - shadow_bias * lightcoord.w, lightcoord.w);
+		float lit = textureProj(shadowMap, lc);
+		fColor.rgb = mix(fColor.rgb, shadow_color.rgb, shadow_color.a * (1 - lit));
+	}
+
 } 
 
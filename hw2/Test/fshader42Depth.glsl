@@ -0,0 +1,15 @@
+/*****************************
+ * File: fshader42Depth.glsl
+ *       Shadow map pass: only depth is written
+ *****************************/
+
+#version 150  
+in vec2 latcoord;
+
+uniform bool f_lattice = false;
+
+void main() 
+{ 
+	if (f_lattice && fract(4 * latcoord.x) < 0.35 && fract(4 * latcoord.y) < 0.35)
+		discard;
+}
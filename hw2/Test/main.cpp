@@ -26,51 +26,153 @@
 **************************************************************/
 #include "Angel-yjc.h"
 #include <string>
+#include <string.h>
+#include <stddef.h>
+#include <sstream>
+#include <ctype.h>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
 #include "texmap.c"
 #include "main.h"
-
-typedef Angel::vec4  color4;
-typedef Angel::vec3  point3;
-
-// Utility type for passing VBOs to render
-struct ObjBuffer {
-	GLuint id;
-	int size;
-	vec4 ambient, diffuse, specular;
-	float shininess;
-};
+#include "GLState.h"
+#include "RenderQueue.h"
+#include "FrameGraph.h"
+#include "Batch.h"
+#include "RollPath.h"
+#include "InstanceBuffer.h"
+#include "Scene.h"
+#include "TripleBuffer.h"
+#include "JobSystem.h"
+#include "MeshLoader.h"
+#include "GLHandle.h"
+#include "VertexPool.h"
+#include "MaterialTable.h"
 
 GLuint Angel::InitShader(const char* vShaderFile, const char* fShaderFile);
 
-GLuint program;       /* shader program object id */
-GLuint programParticle;       /* shader program object id */
+GLProgram program;       /* shader program object id */
+GLProgram programParticle;       /* shader program object id */
+GLProgram programDepth;       /* shader program object id */
 
+// Build a program from SubmitShader() once the driver is done with it.
+// FinishShader() deletes a program that failed, so the handle gives up
+// ownership for the call.
+void finishProgram(GLProgram& p)
+{
+	GLuint id = p.release();
+	p.reset(FinishShader(id));
+}
+
+// Meshes; the scene's entities refer to them
 ObjBuffer floor_buf;  /* vertex buffer object id for floor */
 ObjBuffer sphere;
-ObjBuffer sphere_shadow;
-ObjBuffer axis;
+ObjBuffer axes[3];    // x, y and z, one line each
 ObjBuffer particles;
 
-GLuint checkerTexture;
-GLuint stripeTexture;
+// Materials of the meshes, in the order makeMaterials() adds them
+enum MaterialId { MAT_NONE, MAT_AXIS, MAT_FLOOR, MAT_BALL };
+MaterialTable materials;  // on texture unit 4, "materials" in the shaders
+
+// Everything drawn.  applySettings() writes the entities' materials from
+// the ...Flag globals whenever a key or menu changes them.
+Scene scene;
+Scene::Entity ballEntity, axisEntities[3], floorEntity, particleEntity;
 
-mat4 ballMatrix = mat4(1.0f);
+// Bound once to their own units, so a draw picks one by its switches alone
+GLTexture checkerTexture;  // unit 5, "checkerTex" in fshader42
+GLTexture stripeTexture;   // unit 6, "stripeTex" in fshader42
+
+// Shadow map: depth rendered from light_source, sampled by fshader42 on
+// texture unit 1 for every receiver
+const GLsizei shadowMapSize = 2048;
+GLTexture shadowMapTexture;
+GLFramebuffer shadowMapFramebuffer;  // 0 if it could not be created
+
+RenderQueue renderQueue;
+FrameGraph frameGraph;
+
+// Frame graph passes, declared in this order by makeFrameGraph()
+enum RenderPass {
+	PASS_SHADOW_MAP, PASS_OPAQUE, PASS_PARTICLES, PASS_COUNT
+};
+
+// Frame graph resource written by the shadow map pass
+const unsigned RES_SHADOW_MAP = FrameGraph::FirstUserResource;
+
+// Shader feature switches carried in DrawCall::switches for "program".
+// Except for SW_INSTANCED and SW_MULTI_DRAW they are per draw in a
+// multi-draw, so draws with different switches still batch.
+enum ShaderSwitch {
+	SW_LIGHTING = 1, SW_SHADING = 2, SW_LATTICE = 4, SW_FLOOR_TEXTURE = 8,
+	SW_SHADOW = 16,
+	SW_SPHERE_TEXTURE_SHIFT = 5,  // f_sphereTexture (0-2) in bits 5-6
+	SW_INSTANCED = 128,
+	SW_MULTI_DRAW = 256
+};
+
+// Rolling balls, all drawn by one instanced draw of "sphere".  Ball 0
+// follows ballPath, the others random loops; '+' and '-' change the count.
+// The paths and tints are fixed once the simulation thread runs.
+const int MaxBalls = 8192;
+std::atomic<int> ballCount(1);
+std::vector<RollPath> ballPaths;
+std::vector<vec4> ballTints;
+InstanceBuffer ballInstances;  // on texture unit 2, "instances" in the shaders
+
+// Multi-draw: drawMeshes() draws a batch of meshes of one vertex pool page
+// with one glMultiDrawArraysIndirect().  Each draw's model transform,
+// material index and switches go to "drawData" (texture unit 3),
+// MultiDrawTexels texels per draw; the shaders find them through vDrawId,
+// which reads the draw's base instance from "drawIds".
+const int MaxMultiDraw = 4096;   // draws per glMultiDrawArraysIndirect()
+const int MultiDrawTexels = 4;   // model rows 0-2, material index in x, switches in y
+struct DrawArraysIndirectCommand {
+	GLuint count, instanceCount, first, baseInstance;
+};
+bool multiDraw;                  // supported, see initMultiDraw()
+InstanceBuffer drawData;
+GLBuffer drawIds, drawCommands;
+std::vector<vec4> drawTexels;
+std::vector<DrawArraysIndirectCommand> drawCommandList;
+int multiDrawCalls, multiDrawDraws; // glMultiDrawArraysIndirect()s and their draws, last frame
+std::atomic<float> ballExtent(1.0f); // ball mesh's radius, for the simulation thread
+
+// One simulated frame, published by the simulation thread through
+// "frames" and drawn by display().  A slot is reused two publishes later.
+struct FrameState {
+	InstanceData balls;           // transform and tint of each ball
+	vec3 ballsMin, ballsMax;      // box around all of them
+	unsigned burst;               // firework burst number, 0: none yet
+	float particleTime;           // ms since that burst started
+	std::vector<vec3> particleVelocity;
+	std::vector<vec4> particleColor;
+	FrameState() : burst(0), particleTime(0.f) {}
+};
+TripleBuffer<FrameState> frames;
+constexpr mat4 axis_model = Scale(10.0f, 10.0f, 10.0f);
+// Shadow lookups: map [-1,1] clip coordinates to [0,1] texture coordinates
+constexpr mat4 shadow_bias(vec4(0.5f, 0.0f, 0.0f, 0.5f),
+                           vec4(0.0f, 0.5f, 0.0f, 0.5f),
+                           vec4(0.0f, 0.0f, 0.5f, 0.5f),
+                           vec4(0.0f, 0.0f, 0.0f, 1.0f));
 
 // Projection transformation parameters
 GLfloat  fovy = 45.0;  // Field-of-view in Y direction angle (in degrees)
 GLfloat  aspect;       // Viewport aspect ratio
 GLfloat  zNear = 0.05f, zFar = 30.0;
+int winWidth = 512, winHeight = 512;
 
-GLfloat angleCounter = 0.0; // rotation angle in degrees
-vec4 init_eye(7.0, 3.0, -10.0, 1.0); // initial viewer position
+constexpr vec4 init_eye(7.0, 3.0, -10.0, 1.0); // initial viewer position
 vec4 eye = init_eye;               // current viewer position
 
 //vec4 light_source(0.f, 3.f, 0.f, 0.f);
-vec4 light_source(-14.f, 12.f, -3.f, 1.f);
-vec4 shadow_color(.25f, .25f, .25f, .65f);
+constexpr vec4 light_source(-14.f, 12.f, -3.f, 1.f);
+constexpr vec4 shadow_color(.25f, .25f, .25f, .65f);
 
 int animationFlag = 1; // 1: animation; 0: non-animation. Toggled by key 'a' or 'A'
-int rollFlag = 1;		// 1: animation; 0: non-animation. Toggled by right mouse button down
+std::atomic<int> rollFlag(1);	// 1: animation; 0: non-animation. Toggled by right mouse button down
 int sphereFlag = 1;   // 1: solid sphere; 0: wireframe sphere. Toggled by key 'c' or 'C'
 int floorFlag = 1;  // 1: solid floor; 0: wireframe floor. Toggled by key 'f' or 'F'
 int shadowFlag = 1;
@@ -103,44 +205,83 @@ enum menuOptions {
 	MENU_FIREWORK_ON, MENU_FIREWORK_OFF
 };
 
-void registerObj(GLuint& buf_id, int size, vec3* buf_points, vec4* buf_colors, vec3* buf_normals = nullptr, vec2* buf_texture = nullptr) {
-	glGenBuffers(1, &buf_id);
-	glBindBuffer(GL_ARRAY_BUFFER, buf_id);
-	glBufferData(GL_ARRAY_BUFFER, size  * (
-		sizeof(vec3) +
-		sizeof(vec4) +
-		sizeof(vec3) +
-		sizeof(vec2) 
-		), NULL, GL_STATIC_DRAW);
-	GLsizei ind = 0;
-	glBufferSubData(GL_ARRAY_BUFFER, ind, size * sizeof(vec3), buf_points);
-	ind += size * sizeof(vec3);
-	glBufferSubData(GL_ARRAY_BUFFER, ind, size * sizeof(vec4), buf_colors);
-	ind += size * sizeof(vec4);			  
-	glBufferSubData(GL_ARRAY_BUFFER, ind, size * sizeof(vec3), buf_normals);
-	ind += size * sizeof(vec3);			  
-	glBufferSubData(GL_ARRAY_BUFFER, ind, size * sizeof(vec2), buf_texture);
-	ind += size * sizeof(vec2);
-}
-
-ObjBuffer makeAxis() {
-	point3 points[6] = {
+// All static meshes share the pages of one pool, as ranges of Vertex
+VertexPool vertexPool(4 << 20, GL_STATIC_DRAW, VertexBytes);
+
+// The block of vertexPool that holds obj
+VertexBlock vertexBlock(const ObjBuffer& obj) {
+	VertexBlock block = { obj.id, obj.offset, GLsizeiptr(obj.size * VertexBytes) };
+	return block;
+}
+
+// A block of vertexPool holding the vertices built from these arrays.
+// Missing normals and texture coordinates are zero.  The vertices are
+// written straight into the mapped block.  Sets obj's buffer, offset and
+// vertex count.
+void registerObj(ObjBuffer& obj, int size, const vec3* buf_points, const vec4* buf_colors, const vec3* buf_normals = nullptr, const vec2* buf_texture = nullptr) {
+	size_t bytes = size * VertexBytes;
+	VertexBlock block = vertexPool.allocate(bytes);
+	obj.id = block.buffer;
+	obj.offset = block.offset;
+	obj.size = size;
+	glState.bindBuffer(GL_ARRAY_BUFFER, block.buffer);
+	auto fill = [&](Vertex* v) {
+		for (int i = 0; i < size; i++) {
+			v[i].color = buf_colors[i];
+			v[i].point = buf_points[i];
+			v[i].normal = buf_normals ? buf_normals[i] : vec3(0.0f, 0.0f, 0.0f);
+			v[i].uv = buf_texture ? buf_texture[i] : vec2(0.0f, 0.0f);
+		}
+	};
+	Vertex* dst = (Vertex*)glMapBufferRange(GL_ARRAY_BUFFER, block.offset, bytes,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+	if (dst) {
+		fill(dst);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+	else { // no mapping: the same vertices through one staging copy
+		std::vector<Vertex> staging(size);
+		fill(&staging[0]);
+		glBufferSubData(GL_ARRAY_BUFFER, block.offset, bytes, &staging[0]);
+	}
+}
+
+// Object-space bounding box and sphere of the n points of obj
+void setBounds(ObjBuffer& obj, const point3* points, int n) {
+	Points p;
+	p.resize(n);
+	for (int i = 0; i < n; i++)
+		p.set(i, points[i]);
+	computeAABB(p, obj.boundsMin, obj.boundsMax);
+	obj.radius = computeRadius(p);
+}
+
+// Axis k (0: x, 1: y, 2: z) as one line from the origin
+ObjBuffer makeAxis(int k) {
+	static constexpr point3 points[6] = {
 		{0.0f,0.0f,0.0f}, {1.0f,0.0f,0.0f},
 		{0.0f,0.0f,0.0f}, {0.0f,1.0f,0.0f},
 		{0.0f,0.0f,0.0f}, {0.0f,0.0f,1.0f}
 	};
-	color4 colors[6] = {
+	static constexpr color4 colors[6] = {
 		{1.0f,0.0f,0.0f,1.0f}, {1.0f,0.0f,0.0f,1.0f},
 		{1.0f,0.0f,1.0f,1.0f}, {1.0f,0.0f,1.0f,1.0f},
 		{0.0f,0.0f,1.0f,1.0f}, {0.0f,0.0f,1.0f,1.0f},
 	};
-	GLuint id;
-	registerObj(id, 6, points, colors);
-	ObjBuffer obj = { id, 6 };
-	obj.ambient = { 1.0f,0.0f,0.0f };
+	ObjBuffer obj = {};
+	registerObj(obj, 2, points + 2 * k, colors + 2 * k);
+	obj.material = MAT_AXIS;
+	setBounds(obj, points + 2 * k, 2);
 	return obj;
 }
 
+constexpr point3 floor_corners[4] = {
+	{ 5.0f,0.0f,8.0f },
+	{ 5.0f,0.0f,-4.0f },
+	{ -5.0f,0.0f,-4.0f },
+	{ -5.0f,0.0f,8.0f }
+};
+
 ObjBuffer makePlane(point3 p1, point3 p2, point3 p3, point3 p4) {
 	color4 c { 0.0, 1.0, 0.0, 1.0 };
 	vec3 n = normalize(cross(p1-p2,p1-p3));
@@ -157,31 +298,33 @@ ObjBuffer makePlane(point3 p1, point3 p2, point3 p3, point3 p4) {
 		{0,0},
 		{w/2,0}
 	};
-	GLuint id;
-	registerObj(id, 6, floor_points, floor_colors, floor_normals, floor_uv);
-	return { id, 6, {0.2, 0.2, 0.2, 1.0}, {0.0, 1.0, 0.0, 1.0}, {0.0, 0.0, 0.0, 1.0} };
+	ObjBuffer obj = {};
+	registerObj(obj, 6, floor_points, floor_colors, floor_normals, floor_uv);
+	obj.material = MAT_FLOOR;
+	setBounds(obj, floor_points, 6);
+	return obj;
 }
 
-vec4* pColor;
-vec3* pVelocity;
-float initialTime = 0.f;
+unsigned uploadedBurst = 0;   // burst in the particle buffer
+float frameParticleTime = 0.f; // FrameState::particleTime of the frame being drawn
+GLBuffer particleBuffer;      // rewritten every burst, so not in vertexPool
 ObjBuffer makeParticles(int N) {
-	pColor = new vec4[N];
-	pVelocity = new vec3[N];
-	GLuint id;
-	glGenBuffers(1, &id);
-	glBindBuffer(GL_ARRAY_BUFFER, id);
+	particleBuffer = GLBuffer::create();
+	glState.bindBuffer(GL_ARRAY_BUFFER, particleBuffer);
 
 	glBufferData(GL_ARRAY_BUFFER,
 		(sizeof(vec4) + sizeof(vec3) )* N,
 		NULL, GL_STATIC_DRAW);
-	return { id, N };
+	ObjBuffer obj = {};
+	obj.id = particleBuffer;
+	obj.size = N;
+	return obj;
 }
 
-void startParticles(ObjBuffer ob) {
-	glBindBuffer(GL_ARRAY_BUFFER, ob.id);
-
-	for (int i = 0; i < ob.size; i++) {
+// New random velocities and colors for a firework burst; no GL, this runs
+// on the simulation thread
+void makeBurst(std::vector<vec3>& pVelocity, std::vector<vec4>& pColor) {
+	for (size_t i = 0; i < pVelocity.size(); i++) {
 		pVelocity[i] = vec3(
 			2.0*((rand() % 256) / 256.0 - 0.5),
 			1.2*2.0*((rand() % 256) / 256.0),
@@ -192,86 +335,420 @@ void startParticles(ObjBuffer ob) {
 			(rand() % 256) / 256.0,
 			1.0);
 	}
+}
 
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vec3) * ob.size, pVelocity);
+void uploadParticles(const ObjBuffer& ob, const std::vector<vec3>& pVelocity, const std::vector<vec4>& pColor) {
+	glState.bindBuffer(GL_ARRAY_BUFFER, ob.id);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vec3) * ob.size, &pVelocity[0]);
 	glBufferSubData(GL_ARRAY_BUFFER, sizeof(vec3) * ob.size,
-		sizeof(vec4) * ob.size, pColor);
-
-	initialTime = (float) glutGet(GLUT_ELAPSED_TIME);
-}
-
-ObjBuffer read_obj(const char* file, color4 color)
-{
-	std::ifstream fs;
-	fs.open(file);
-	ObjBuffer obj;
-	if (fs.is_open()) {
-		int total;
-		fs >> total;
-		total *= 3;
-		point3 *obj_array = new point3[total];
-		vec3 *obj_normals = new vec3[total];
-		color4 *obj_colors = new color4[total];
-		int verts;
-		int i = 0;
-		while (fs >> verts) {
-			vec3 p1;
-			fs >> p1;
-			vec3 p2;
-			fs >> p2;
-			vec3 p3;
-			fs >> p3;
-			vec3 n = normalize(cross(p2-p1, p3 - p1));
-			obj_normals[i] = n;
-			obj_colors[i] = color;
-			obj_array[i++] = p1;
-			obj_normals[i] = n;
-			obj_colors[i] = color;
-			obj_array[i++] = p2;
-			obj_normals[i] = n;
-			obj_colors[i] = color;
-			obj_array[i++] = p3;
-		}
-		GLuint buf_id;
-		registerObj(buf_id, total, obj_array, obj_colors, obj_normals);
-		obj = { buf_id, total };
-		delete[] obj_array;
-		delete[] obj_normals;
-		delete[] obj_colors;
-	}
-	else {
+		sizeof(vec4) * ob.size, &pColor[0]);
+}
+
+// Whitespace-separated numbers in the n characters at s (which must be
+// followed by a NUL).  The text is scanned in chunks on the job system:
+// countNumbers() counts the numbers starting in each chunk, and
+// parseNumbers() then parses every chunk knowing the index of its first
+// number, handing each number to put(index, value).
+struct NumberChunks {
+	size_t step;
+	std::vector<size_t> first; // index of each chunk's first number; last: total
+};
+
+static inline bool numberStarts(const char* s, size_t i)
+{
+	return !isspace((unsigned char)s[i]) && (i == 0 || isspace((unsigned char)s[i - 1]));
+}
+
+static void countNumbers(const char* s, size_t n, NumberChunks& chunks)
+{
+	chunks.step = jobSystem.chunkSize(n, 1 << 16);
+	chunks.first.assign((n + chunks.step - 1) / chunks.step + 1, 0);
+	jobSystem.parallelFor(n, chunks.step, [&](size_t b, size_t e, unsigned c) {
+		size_t count = 0;
+		for (size_t i = b; i < e; i++) count += numberStarts(s, i);
+		chunks.first[c + 1] = count;
+	});
+	for (size_t c = 1; c < chunks.first.size(); c++) chunks.first[c] += chunks.first[c - 1];
+}
+
+template <class F>
+static void parseNumbers(const char* s, size_t n, const NumberChunks& chunks, F put)
+{
+	jobSystem.parallelFor(n, chunks.step, [&](size_t b, size_t e, unsigned c) {
+		size_t k = chunks.first[c];
+		for (size_t i = b; i < e; i++)
+			if (numberStarts(s, i)) put(k++, strtof(s + i, nullptr));
+	});
+}
+
+// File layout: the triangle count, then per triangle its vertex count
+// (always 3) and three points.  Needs no GL: it runs as a MeshLoader job.
+// The file's text and the mesh both live in "arena"; the points are
+// parsed straight into the mesh, with no list of numbers in between.
+bool read_obj(const char* file, const color4& color, MeshData& mesh, StagingArena& arena)
+{
+	std::ifstream fs(file, std::ios::binary);
+	if (!fs.is_open()) {
 		std::cout << "no file read\n";
+		return false;
 	}
+	fs.seekg(0, std::ios::end);
+	size_t n = size_t(fs.tellg());
+	fs.seekg(0, std::ios::beg);
+	char* text = arena.allocate<char>(n + 1);
+	fs.read(text, n);
+	n = size_t(fs.gcount());
+	text[n] = 0;
 	fs.close();
-	obj.ambient = { 0.2, 0.2, 0.2, 1.0 };
-	obj.specular = { 1.0, 0.84, 0.0, 1.0 };
-	obj.diffuse = { 1.0, 0.84, 0.0, 1.0 };
-	obj.shininess = 125.f;
+
+	NumberChunks chunks;
+	countNumbers(text, n, chunks);
+	size_t numbers = chunks.first.back();
+	const size_t Record = 10; // vertex count + 3 points
+	const char* head = text;
+	while (isspace((unsigned char)*head)) head++;
+	int triangles = numbers == 0 ? 0 : int(strtol(head, nullptr, 10));
+	int complete = numbers == 0 ? 0 : int((numbers - 1) / Record);
+	if (triangles > complete) triangles = complete;
+	if (triangles <= 0) return false;
+
+	mesh.allocate(arena, triangles * 3);
+	Vertex *obj_array = mesh.data;
+
+	size_t used = 1 + size_t(triangles) * Record;
+	parseNumbers(text, n, chunks, [=](size_t k, float v) {
+		if (k == 0 || k >= used) return;
+		size_t f = (k - 1) % Record; // 0: vertex count, then 3 * xyz
+		if (f > 0)
+			obj_array[(k - 1) / Record * 3 + (f - 1) / 3].point[int((f - 1) % 3)] = v;
+	});
+
+	// Per-triangle attributes, and the bounds from a partial box and
+	// sphere per chunk
+	size_t step = jobSystem.chunkSize(triangles, 1024);
+	std::vector<vec3> partLo((triangles + step - 1) / step), partHi(partLo.size());
+	std::vector<float> partR2(partLo.size());
+	jobSystem.parallelFor(triangles, step, [&](size_t b, size_t e, unsigned c) {
+		vec3 lo(1e30f), hi(-1e30f);
+		float r2 = 0.0f;
+		for (size_t i = b * 3; i < e * 3; i += 3) {
+			const point3 &p1 = obj_array[i].point, &p2 = obj_array[i + 1].point, &p3 = obj_array[i + 2].point;
+			vec3 n = normalize(cross(p2 - p1, p3 - p1));
+			for (size_t j = i; j < i + 3; j++) {
+				obj_array[j].color = color;
+				obj_array[j].normal = n;
+				obj_array[j].uv = vec2(0.0f, 0.0f);
+			}
+			for (int k = 0; k < 3; k++) {
+				lo[k] = fminf(lo[k], fminf(p1[k], fminf(p2[k], p3[k])));
+				hi[k] = fmaxf(hi[k], fmaxf(p1[k], fmaxf(p2[k], p3[k])));
+			}
+			r2 = fmaxf(r2, fmaxf(dot(p1, p1), fmaxf(dot(p2, p2), dot(p3, p3))));
+		}
+		partLo[c] = lo;
+		partHi[c] = hi;
+		partR2[c] = r2;
+	});
+	mesh.boundsMin = vec3(1e30f);
+	mesh.boundsMax = vec3(-1e30f);
+	float r2 = 0.0f;
+	for (size_t c = 0; c < partLo.size(); c++) {
+		r2 = fmaxf(r2, partR2[c]);
+		for (int k = 0; k < 3; k++) {
+			mesh.boundsMin[k] = fminf(mesh.boundsMin[k], partLo[c][k]);
+			mesh.boundsMax[k] = fmaxf(mesh.boundsMax[k], partHi[c][k]);
+		}
+	}
+	mesh.radius = sqrtf(r2);
+	return true;
+}
+
+// Stand-in for a mesh still loading: an octahedron (the "sphere.8" shape)
+// with flat normals and the mesh's material
+ObjBuffer makePlaceholder(const color4& color, int material)
+{
+	point3 points[24];
+	vec3 normals[24];
+	color4 colors[24];
+	int i = 0;
+	for (int f = 0; f < 8; f++) {
+		vec3 s(f & 1 ? -1.0f : 1.0f, f & 2 ? -1.0f : 1.0f, f & 4 ? -1.0f : 1.0f);
+		vec3 n = normalize(s);
+		point3 x(s.x, 0.0f, 0.0f), y(0.0f, s.y, 0.0f), z(0.0f, 0.0f, s.z);
+		bool ccw = dot(cross(y - x, z - x), n) > 0; // outward facing
+		points[i] = x;  points[i + 1] = ccw ? y : z;  points[i + 2] = ccw ? z : y;
+		for (int k = 0; k < 3; k++, i++) {
+			normals[i] = n;
+			colors[i] = color;
+		}
+	}
+	ObjBuffer obj = {};
+	registerObj(obj, 24, points, colors, normals);
+	setBounds(obj, points, 24);
+	obj.material = material;
 	return obj;
 }
+
+// The ball mesh: a placeholder until meshFile has loaded.  Loaded meshes
+// stream in through meshLoader at most UploadBudget bytes per tick.
+enum { MeshSphere };
+std::string meshFile = "sphere.1024";
+// A global, so the loader's lambda need not carry an over-aligned value
+// (MSVC on Win32 rejects passing those by value)
+constexpr color4 sphere_color(1.0, 0.84, 0.0, 1.0);
+MeshLoader meshLoader(vertexPool);
+const size_t UploadBudget = 4 << 20;
+const int StreamInterval = 16; // ms
+
+void streamMeshes(int)
+{
+	LoadedMesh done;
+	if (meshLoader.pump(UploadBudget, done) && done.tag == MeshSphere) {
+		vertexPool.free(vertexBlock(sphere));
+		sphere.id = done.block.buffer;
+		sphere.offset = done.block.offset;
+		sphere.size = done.vertices;
+		sphere.boundsMin = done.boundsMin;
+		sphere.boundsMax = done.boundsMax;
+		sphere.radius = done.radius;
+		ballExtent = sphere.radius;
+		glutPostRedisplay();
+	}
+	if (meshLoader.busy())
+		glutTimerFunc(StreamInterval, streamMeshes, 0);
+}
+
+// Shadows: every caster is drawn once into the shadow map, and the
+// receivers compare against it while they are shaded.  The shadow map
+// pass depth tests against the map itself.  Opaque and particles draw
+// into the window's color and depth, so they merge into one slot.
+void makeFrameGraph()
+{
+	const unsigned C = FrameGraph::Color, D = FrameGraph::Depth, M = RES_SHADOW_MAP;
+	frameGraph.addPass("shadow map", M,     M);
+	frameGraph.addPass("opaque",     D | M, C | D, 1);
+	frameGraph.addPass("particles",  D,     C | D, 1);
+}
+
+// Depth texture and framebuffer for the shadow map.  Lookups compare
+// against the stored depth with linear filtering (2x2 PCF); outside the
+// map everything is lit.
+void makeShadowMap()
+{
+	shadowMapTexture = GLTexture::create();
+	glState.activeTexture(GL_TEXTURE1);
+	glState.bindTexture(GL_TEXTURE_2D, shadowMapTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, shadowMapSize, shadowMapSize,
+		0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	GLfloat border[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glState.activeTexture(GL_TEXTURE0);
+
+	shadowMapFramebuffer = GLFramebuffer::create();
+	glState.bindFramebuffer(shadowMapFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadowMapTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		printf("Shadow map framebuffer incomplete, shadows disabled\n");
+		shadowMapFramebuffer.reset();
+	}
+	glState.bindFramebuffer(0);
+}
+
+// The light's projection * view.  It looks at the middle of the floor and
+// covers the floor and anything standing on it.
+mat4 lightMatrix()
+{
+	vec4 at(0.0, 0.0, 2.0, 1.0);
+	vec4 up(0.0, 1.0, 0.0, 0.0);
+	return Perspective(45.0f, 1.0f, 8.0f, 30.0f) * LookAt(light_source, at, up);
+}
+
+//Path of the rolling ball, a loop through these centers (radius 1)
+static constexpr vec3 ballKeyframes[] = {
+	vec3(-4, 1, 4),
+	vec3(-1, 1, -4),
+	vec3(3, 1, 5 ), };
+const RollPath ballPath(ballKeyframes, sizeof(ballKeyframes) / sizeof(vec3));
+
+// Paths and tints for MaxBalls balls.  The extra loops have three random
+// corners on the floor.
+void makeBalls()
+{
+	ballPaths.assign(1, ballPath);
+	ballTints.assign(1, vec4(1.0, 1.0, 1.0, 1.0));
+	for (int i = 1; i < MaxBalls; i++) {
+		vec3 corners[3];
+		for (int k = 0; k < 3; k++)
+			corners[k] = vec3(-4.0 + 8.0 * ((rand() % 256) / 256.0), 1.0,
+				-3.0 + 10.0 * ((rand() % 256) / 256.0));
+		ballPaths.push_back(RollPath(corners, 3));
+		ballTints.push_back(vec4(0.4 + 0.6 * ((rand() % 256) / 256.0),
+			0.4 + 0.6 * ((rand() % 256) / 256.0),
+			0.4 + 0.6 * ((rand() % 256) / 256.0), 1.0));
+	}
+	ballInstances.create(GL_TEXTURE2);
+}
+
+// CPU update stage: the transforms of the first ballCount balls after
+// rolling "angle" radians, and the box around them.  The balls are
+// split over the job system, each chunk with its own partial box.
+void updateBalls(float angle, FrameState& f)
+{
+	int count = ballCount;
+	f.balls.resize(count);
+	size_t step = jobSystem.chunkSize(count, 256);
+	std::vector<vec3> partLo((count + step - 1) / step), partHi(partLo.size());
+	jobSystem.parallelFor(count, step, [&](size_t b, size_t e, unsigned c) {
+		vec3 lo(1e30f), hi(-1e30f);
+		for (size_t i = b; i < e; i++) {
+			vec3 center;
+			quat orientation;
+			ballPaths[i].evaluate(angle * ballPaths[i].radius(), center, orientation);
+			f.balls.set(int(i), Translate(center) * Rotate(orientation), ballTints[i]);
+			for (int k = 0; k < 3; k++) {
+				lo[k] = fminf(lo[k], center[k]);
+				hi[k] = fmaxf(hi[k], center[k]);
+			}
+		}
+		partLo[c] = lo;
+		partHi[c] = hi;
+	});
+	vec3 lo(1e30f), hi(-1e30f);
+	for (size_t c = 0; c < partLo.size(); c++) {
+		for (int k = 0; k < 3; k++) {
+			lo[k] = fminf(lo[k], partLo[c][k]);
+			hi[k] = fmaxf(hi[k], partHi[c][k]);
+		}
+	}
+
+	// The centers' box grown by the sphere's extent in any orientation
+	GLfloat r = ballExtent;
+	f.ballsMin = lo - vec3(r);
+	f.ballsMax = hi + vec3(r);
+}
+
+//----------------------------------------------------------------------------
+// Simulation thread.  It steps the balls and the fireworks SimRate times
+// a second, each step into frames.back(), and publishes it; display()
+// draws whatever step is newest.  It starts with the animation ('b').
+#define ANIMATION_T 1500.f  // ms between firework bursts
+const float RollSpeed = 1.0f;  // radians per second
+const int SimRate = 120;
+std::thread simThread;
+std::atomic<bool> simRunning(false);
+
+void simulate()
+{
+	typedef std::chrono::steady_clock clock;
+	clock::time_point last = clock::now(), burstStart = last, next = last;
+	float angle = 0.f;
+	unsigned burst = 0;
+	std::vector<vec3> velocity(particles.size);
+	std::vector<vec4> color(particles.size);
+
+	while (simRunning) {
+		clock::time_point now = clock::now();
+		if (rollFlag)
+			angle += RollSpeed * std::chrono::duration<float>(now - last).count();
+		last = now;
+		float particleTime = std::chrono::duration<float, std::milli>(now - burstStart).count();
+		if (burst == 0 || particleTime > ANIMATION_T) {
+			makeBurst(velocity, color);
+			burst++;
+			burstStart = now;
+			particleTime = 0.f;
+		}
+
+		FrameState& f = frames.back();
+		updateBalls(angle, f);
+		if (f.burst != burst) { // this slot last saw an older burst
+			f.particleVelocity = velocity;
+			f.particleColor = color;
+			f.burst = burst;
+		}
+		f.particleTime = particleTime;
+		frames.publish();
+
+		next += std::chrono::microseconds(1000000 / SimRate);
+		std::this_thread::sleep_until(next);
+	}
+}
+
+void stopSimulation()
+{
+	simRunning = false;
+	if (simThread.joinable())
+		simThread.join();
+}
+
+void startSimulation()
+{
+	if (simRunning)
+		return;
+	simRunning = true;
+	simThread = std::thread(simulate);
+	atexit(stopSimulation); // join before the globals it uses go away
+}
+
+// Until the simulation runs, the GL thread publishes the still frame
+// itself (balls at the start of their paths)
+void publishStill()
+{
+	updateBalls(0.f, frames.back());
+	frames.publish();
+	frames.update();
+}
+
+// Scene setup, defined with the render queue callbacks below
+void initMultiDraw();
+void makeMaterials();
+void makeScene();
+void applySettings();
+void releaseResources();
+
 //----------------------------------------------------------------------------
 // OpenGL initialization
 void init()
 {
-	std::cout << "Enter an object file: \n";
-	std::string file;
-	std::getline(std::cin, file);
-	if (file.size() == 0) file = "sphere.1024";
-	sphere = read_obj(file.c_str(), { 1.0, 0.84, 0.0, 1.0});
-	sphere_shadow = read_obj(file.c_str(), { 0.25, 0.25, 0.25, 0.65 });
+	// Queue the shaders first so the driver compiles them while we load
+	// meshes; display() checks them with FinishShader() on first use.
+	program = GLProgram(SubmitShader("vshader42.glsl", "fshader42.glsl"));
+	programParticle = GLProgram(SubmitShader("vshader42Particle.glsl", "fshader42Particle.glsl"));
+	programDepth = GLProgram(SubmitShader("vshader42Depth.glsl", "fshader42Depth.glsl"));
+
+	// The first frame shows the placeholder; the mesh follows once loaded
+	makeMaterials();
+	sphere = makePlaceholder(sphere_color, MAT_BALL);
+	std::string file = meshFile;
+	meshLoader.load(MeshSphere, [file](MeshData& mesh, StagingArena& arena) {
+		return read_obj(file.c_str(), sphere_color, mesh, arena);
+	});
+	glutTimerFunc(StreamInterval, streamMeshes, 0);
 	particles = makeParticles(300);
-	floor_buf = makePlane(
-		{ 5.0f,0.0f,8.0f },
-		{ 5.0f,0.0f,-4.0f },
-		{ -5.0f,0.0f,-4.0f },
-		{ -5.0f,0.0f,8.0f });
-
-	axis = makeAxis();
+	floor_buf = makePlane(floor_corners[0], floor_corners[1], floor_corners[2], floor_corners[3]);
+
+	for (int k = 0; k < 3; k++)
+		axes[k] = makeAxis(k);
+	makeFrameGraph();
+	makeShadowMap();
+	makeBalls();
+	initMultiDraw();
+	makeScene();
+	publishStill(); //calculate transformations once
 // Image set up
 	// texture processing using repeat and nearest
 	image_set_up();
-	glGenTextures(1, &checkerTexture);
-	glBindTexture(GL_TEXTURE_2D, checkerTexture);
+	checkerTexture = GLTexture::create();
+	glState.activeTexture(GL_TEXTURE5);
+	glState.bindTexture(GL_TEXTURE_2D, checkerTexture);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -279,250 +756,511 @@ void init()
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, ImageWidth, ImageHeight,
 		0, GL_RGBA, GL_UNSIGNED_BYTE, Image);
 
-	glGenTextures(1, &stripeTexture);
-	glBindTexture(GL_TEXTURE_2D, stripeTexture);
+	stripeTexture = GLTexture::create();
+	glState.activeTexture(GL_TEXTURE6);
+	glState.bindTexture(GL_TEXTURE_1D, stripeTexture);
 	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA, stripeImageWidth,
 		0, GL_RGBA, GL_UNSIGNED_BYTE, stripeImage);
- // Load shaders and create a shader program (to be used in display())
-    program = InitShader("vshader42.glsl", "fshader42.glsl");
-	programParticle = InitShader("vshader42Particle.glsl", "fshader42Particle.glsl");
-    glEnable( GL_DEPTH_TEST );
+	glState.activeTexture(GL_TEXTURE0);
+    glState.enable( GL_DEPTH_TEST, true );
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glClearColor( 0.529f, 0.807f, 0.92f, 0.0);
     glLineWidth(2.0);
+
+	applySettings(); // materials of the entities from makeScene()
+}
+//----------------------------------------------------------------------------
+// Per-frame values used by the draw functions and render queue callbacks below
+GLint  modelViewLoc;     // "model_view" location in program
+GLint  materialLoc;      // "material" location in program
+int    appliedSwitches;  // ShaderSwitch bits currently set in program, -1: unknown
+mat4   frameProjection, frameCamera;
+mat4   frameLight;       // lightMatrix()
+
+//----------------------------------------------------------------------------
+// Point the vertex attributes of "program" at Vertex records starting at
+// byte "base" of the bound GL_ARRAY_BUFFER, and enable them plus the
+// attribute arrays in "extra" (GLState::attribBit()s)
+void setVertexAttribs(GLintptr base, unsigned extra = 0)
+{
+	GLuint vPosition = glGetAttribLocation(program, "vPosition");
+	glVertexAttribPointer(vPosition, 3, GL_FLOAT, GL_FALSE, VertexBytes,
+		BUFFER_OFFSET(base + offsetof(Vertex, point)));
+
+	GLuint vColor = glGetAttribLocation(program, "vColor");
+	glVertexAttribPointer(vColor, 4, GL_FLOAT, GL_FALSE, VertexBytes,
+		BUFFER_OFFSET(base + offsetof(Vertex, color)));
+
+	GLuint vNormal = glGetAttribLocation(program, "vNormal");
+	glVertexAttribPointer(vNormal, 3, GL_FLOAT, GL_FALSE, VertexBytes,
+		BUFFER_OFFSET(base + offsetof(Vertex, normal)));
+
+	GLuint vTexture = glGetAttribLocation(program, "vTexture");
+	glVertexAttribPointer(vTexture, 2, GL_FLOAT, GL_FALSE, VertexBytes,
+		BUFFER_OFFSET(base + offsetof(Vertex, uv)));
+
+	glState.vertexAttribArrays(GLState::attribBit(vPosition) | GLState::attribBit(vColor) |
+		GLState::attribBit(vNormal) | GLState::attribBit(vTexture) | extra);
 }
+
+// The same for the one attribute of "programDepth"
+void setDepthVertexAttribs(GLintptr base)
+{
+	GLuint vPosition = glGetAttribLocation(programDepth, "vPosition");
+	glVertexAttribPointer(vPosition, 3, GL_FLOAT, GL_FALSE, VertexBytes,
+		BUFFER_OFFSET(base + offsetof(Vertex, point)));
+	glState.vertexAttribArrays(GLState::attribBit(vPosition));
+}
+
 //----------------------------------------------------------------------------
 // drawObj(buffer, num_vertices):
 //   draw the object that is associated with the vertex buffer object "buffer"
-//   and has "num_vertices" vertices.
+//   and has "num_vertices" vertices.  instances > 0 draws that many copies
+//   at once (f_instanced has to be set).
 //
-void drawObj(ObjBuffer obj, unsigned int mode)
+void drawObj(ObjBuffer obj, unsigned int mode, GLsizei instances = 0)
 {
     //--- Activate the vertex buffer object to be drawn ---//
-    glBindBuffer(GL_ARRAY_BUFFER, obj.id);
+    glState.bindBuffer(GL_ARRAY_BUFFER, obj.id);
 
     /*----- Set up vertex attribute arrays for each vertex attribute -----*/
-    GLuint vPosition = glGetAttribLocation(program, "vPosition");
-    glEnableVertexAttribArray(vPosition);
-	glVertexAttribPointer(vPosition, 3, GL_FLOAT, GL_FALSE, 0,
-		BUFFER_OFFSET(0));
-	GLuint vColor = glGetAttribLocation(program, "vColor");
-	glEnableVertexAttribArray(vColor);
-	glVertexAttribPointer(vColor, 4, GL_FLOAT, GL_FALSE, 0,
-		BUFFER_OFFSET(sizeof(point3) * obj.size));
-	GLuint vNormal = glGetAttribLocation(program, "vNormal");
-	glEnableVertexAttribArray(vNormal);
-	glVertexAttribPointer(vNormal, 3, GL_FLOAT, GL_FALSE, 0,
-		BUFFER_OFFSET((sizeof(point3) + sizeof(color4)) * obj.size));
-	GLuint vTexture = glGetAttribLocation(program, "vTexture");
-	glEnableVertexAttribArray(vTexture);
-	glVertexAttribPointer(vTexture, 2, GL_FLOAT, GL_FALSE, 0,
-		BUFFER_OFFSET((sizeof(point3) + sizeof(color4) + sizeof(point3)) * obj.size));
-	glUniform4f(glGetUniformLocation(program, "ambient"), obj.ambient.x, obj.ambient.y, obj.ambient.z, obj.ambient.w);
-	glUniform4f(glGetUniformLocation(program, "diffuse"), obj.diffuse.x, obj.diffuse.y, obj.diffuse.z, obj.diffuse.w);
-	glUniform4f(glGetUniformLocation(program, "specular"), obj.specular.x, obj.specular.y, obj.specular.z, obj.specular.w);
-	glUniform1f(glGetUniformLocation(program, "shininess"), obj.shininess);
+	setVertexAttribs(obj.offset);
+	glUniform1i(materialLoc, obj.material);
 
     /* Draw a sequence of geometric objs (triangles) from the vertex buffer
        (using the attributes specified in each enabled vertex attribute array) */
-    glDrawArrays(mode, 0, obj.size);
+    if (instances > 0)
+        glDrawArraysInstanced(mode, 0, obj.size, instances);
+    else
+        glDrawArrays(mode, 0, obj.size);
+}
 
-    /*--- Disable each vertex attribute array being enabled ---*/
-    glDisableVertexAttribArray(vPosition);
-	glDisableVertexAttribArray(vColor);
-	glDisableVertexAttribArray(vNormal);
-	glDisableVertexAttribArray(vTexture);
+//----------------------------------------------------------------------------
+// Set the f_* switch uniforms of "program" that differ from the last draw
+void applySwitches(int switches)
+{
+	if (switches != appliedSwitches)
+		glUniform1i(glGetUniformLocation(program, "switches"), switches);
+	appliedSwitches = switches;
 }
 
-//mat4 shadowMatrix2() {
-//	vec4 normal(0.f, 1.f, 0.f, 0.f);
-//
-//	return dot(light_source, normal) * mat4(1.f) - vmult(normal, light_source);
-//	/* 
-//		p=l-(d+n*l)/(n*(v-l)) (v-l)	
-//	*/
-//}
-
-mat4 shadowMatrix() {
-	return mat4(vec4(light_source[1],-light_source[0],0.f,0.f),
-				vec4(0.f),
-				vec4(0.f,-light_source[2],light_source[1], 0.f),
-				vec4(0.f,-1.f,0.f,light_source[1])
-				);
-}
-
-//Rotate in the direction of delta by angle (radians)
-mat4 Roll(const vec3& delta, float angle, float radius) {
-	vec3 rotvec = cross(vec3(0, 1, 0),delta);
-	return  Rotate(angle*180.f/M_PI, rotvec.x, rotvec.y, rotvec.z);
-}
-//Handles rolling animation to arbitrary points
-mat4 RollAnimation(float angle, float radius = 1.0f) {
-	static vec3 keyframes[] = {
-		vec3(-4, 1, 4), 
-		vec3(-1, 1, -4),
-		vec3(3, 1, 5 ), };
-	static int size = sizeof(keyframes) / sizeof(vec3);
-	static int step = 0;
-	static float lastAngle = 0.0f;
-	static mat4 savedRot = mat4(1.0f);
-	// end static
-	float angleDelta = angle - lastAngle;
-	vec3 a = keyframes[step%size];
-	vec3 b = keyframes[(step+1)%size];
-	vec3 distanceDelta = b-a;
-	float distance = length(distanceDelta);
-	float progress = angleDelta * radius / distance;
-	if (progress > 1.0f) {
-		savedRot = Roll(distanceDelta, distance/radius, radius) * savedRot;
-		lastAngle += distance / radius;
-		step += 1;
-		return RollAnimation(angle, radius);
+// Render queue callback for ObjBuffer meshes drawn with "program"
+void drawMesh(const DrawCall& call)
+{
+	glUniformMatrix4fv(modelViewLoc, 1, GL_TRUE, call.model); // GL_TRUE: matrix is row-major
+	applySwitches(call.switches | (call.instances > 0 ? SW_INSTANCED : 0));
+	drawObj(*call.obj, call.mode, call.instances);
+}
+
+// Whether glMultiDrawArraysIndirect() with base instances is there, and
+// if so the buffers drawMeshes() needs.  The draw id buffer holds 0, 1, 2,
+// ...: read with divisor 1, an instanced attribute from it gives each
+// draw of the batch its own base instance.
+void initMultiDraw()
+{
+#ifdef __APPLE__ // macOS stops at OpenGL 4.1
+	multiDraw = false;
+#else
+	multiDraw = GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+#endif
+	if (!multiDraw)
+		return;
+	drawData.create(GL_TEXTURE3);
+
+	std::vector<GLfloat> ids(MaxMultiDraw);
+	for (int i = 0; i < MaxMultiDraw; i++)
+		ids[i] = GLfloat(i);
+	drawIds = GLBuffer::create();
+	glState.bindBuffer(GL_ARRAY_BUFFER, drawIds);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * MaxMultiDraw, &ids[0], GL_STATIC_DRAW);
+
+	drawCommands = GLBuffer::create();
+	drawTexels.reserve(size_t(MaxMultiDraw) * MultiDrawTexels);
+	drawCommandList.reserve(MaxMultiDraw);
+}
+
+// Render queue batch callback for drawMesh() draws: the RenderQueue only
+// merges calls with the same state and vertex buffer, so they differ just
+// in model, material index, switches and where in the buffer their
+// vertices are.
+void drawMeshes(const DrawCall* const* calls, int count)
+{
+	if (!multiDraw) {
+		for (int i = 0; i < count; i++)
+			drawMesh(*calls[i]);
+		return;
+	}
+	const DrawCall& first = *calls[0];
+	applySwitches(SW_MULTI_DRAW); // the draws' own switches are in drawData
+
+	// All vertices relative to the start of the page; drawIds per draw
+	glState.bindBuffer(GL_ARRAY_BUFFER, drawIds);
+	GLuint vDrawId = glGetAttribLocation(program, "vDrawId");
+	glVertexAttribPointer(vDrawId, 1, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0));
+	glVertexAttribDivisor(vDrawId, 1);
+	glState.bindBuffer(GL_ARRAY_BUFFER, first.obj->id);
+	setVertexAttribs(0, GLState::attribBit(vDrawId));
+
+	for (int b = 0; b < count; b += MaxMultiDraw) {
+		int n = std::min(count - b, MaxMultiDraw);
+		drawTexels.resize(size_t(n) * MultiDrawTexels);
+		drawCommandList.resize(n);
+		for (int i = 0; i < n; i++) {
+			const DrawCall& call = *calls[b + i];
+			const ObjBuffer& obj = *call.obj;
+			vec4* t = &drawTexels[size_t(i) * MultiDrawTexels];
+			t[0] = call.model[0];
+			t[1] = call.model[1];
+			t[2] = call.model[2];
+			t[3] = vec4(GLfloat(obj.material), GLfloat(call.switches), 0.0, 0.0);
+			DrawArraysIndirectCommand& c = drawCommandList[i];
+			c.count = GLuint(obj.size);
+			c.instanceCount = 1;
+			c.first = GLuint(obj.offset / VertexBytes);
+			c.baseInstance = GLuint(i);
+		}
+		drawData.upload(drawTexels);
+		glState.bindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommands);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawArraysIndirectCommand) * n,
+			&drawCommandList[0], GL_STREAM_DRAW);
+		glMultiDrawArraysIndirect(first.mode, BUFFER_OFFSET(0), n, 0);
+		multiDrawCalls++;
+		multiDrawDraws += n;
+	}
+
+	// The divisor belongs to the attribute index, not to "program": any
+	// other program's attribute at this index would read per instance
+	glVertexAttribDivisor(vDrawId, 0);
+}
+
+// Render queue callback for shadow casters drawn into the shadow map
+void drawDepth(const DrawCall& call)
+{
+	glUniformMatrix4fv(glGetUniformLocation(programDepth, "model_view"), 1, GL_TRUE, call.model);
+	glUniform1i(glGetUniformLocation(programDepth, "f_lattice"), (call.switches & SW_LATTICE) != 0);
+	glUniform1i(glGetUniformLocation(programDepth, "f_instanced"), call.instances > 0);
+	glState.bindBuffer(GL_ARRAY_BUFFER, call.obj->id);
+
+	setDepthVertexAttribs(call.obj->offset);
+	if (call.instances > 0)
+		glDrawArraysInstanced(call.mode, 0, call.obj->size, call.instances);
+	else
+		glDrawArrays(call.mode, 0, call.obj->size);
+}
+
+// Render queue callback for the firework particles
+void drawParticles(const DrawCall& call)
+{
+	glUniformMatrix4fv(glGetUniformLocation(programParticle, "model_view"), 1, GL_TRUE, frameCamera * call.model);
+	glUniformMatrix4fv(glGetUniformLocation(programParticle, "projection"), 1, GL_TRUE, frameProjection);
+	glState.bindBuffer(GL_ARRAY_BUFFER, call.obj->id);
+
+	float delta = frameParticleTime;
+	std::cout << delta << std::endl;
+	glUniform1f(glGetUniformLocation(programParticle, "time"), delta);
+	GLuint v = glGetAttribLocation(programParticle, "vVelocity");
+	glVertexAttribPointer(v, 3, GL_FLOAT, GL_FALSE, 0,
+		BUFFER_OFFSET(0));
+
+	GLuint c = glGetAttribLocation(programParticle, "vColor");
+	glVertexAttribPointer(c, 4, GL_FLOAT, GL_FALSE, 0,
+		BUFFER_OFFSET(sizeof(vec3) * call.obj->size));
+	glState.vertexAttribArrays(GLState::attribBit(v) | GLState::attribBit(c));
+	// point size = 3.0
+	glPointSize(3.0);
+	glDrawArrays(GL_POINTS, 0, call.obj->size);
+}
+
+// Distance in front of the camera of the origin of "model", for sort keys
+GLfloat viewDepth(const mat4& model)
+{
+	return -(frameCamera * (model * vec4(0.0, 0.0, 0.0, 1.0))).z;
+}
+
+// Queue a draw into "pass" if the frame graph runs it this frame.  The
+// depth setup follows the pass's reads and (final) writes: reading depth
+// means depth testing.  The shadow map is the depth buffer of its own
+// pass.
+void submitPass(RenderPass pass, DrawCall& call, GLfloat depth, bool backToFront = false)
+{
+	if (!frameGraph.runs(pass))
+		return;
+	unsigned reads = frameGraph.reads(pass), writes = frameGraph.writes(pass);
+	unsigned D = pass == PASS_SHADOW_MAP ? RES_SHADOW_MAP : FrameGraph::Depth;
+	call.colorWrite = (writes & FrameGraph::Color) ? GL_TRUE : GL_FALSE;
+	call.depthWrite = (writes & D) ? GL_TRUE : GL_FALSE;
+	call.depthTest = (reads & D) ? GL_TRUE : GL_FALSE;
+	renderQueue.submit(RenderQueue::makeKey(frameGraph.slot(pass), frameGraph.subpass(pass),
+		call.program, call.texture,
+		call.obj->material, depth, backToFront), call);
+}
+
+// The entities of the scene
+void makeScene()
+{
+	ballEntity = scene.create(sphere, GL_TRIANGLES, PASS_OPAQUE, program, drawMesh);
+	scene.batch[ballEntity] = drawMeshes;
+	scene.flags[ballEntity] |= ENTITY_CASTER | ENTITY_RECEIVER;
+
+	// Three lines of one vertex pool page: one multi-draw
+	for (int k = 0; k < 3; k++) {
+		axisEntities[k] = scene.create(axes[k], GL_LINES, PASS_OPAQUE, program, drawMesh);
+		scene.batch[axisEntities[k]] = drawMeshes;
+		scene.setTransform(axisEntities[k], affine(axis_model));
+	}
+
+	floorEntity = scene.create(floor_buf, GL_TRIANGLES, PASS_OPAQUE, program, drawMesh);
+	scene.batch[floorEntity] = drawMeshes;
+	scene.flags[floorEntity] |= ENTITY_RECEIVER;
+
+	// Velocities in the particle mesh are not positions, so no real bounds
+	particleEntity = scene.create(particles, GL_POINTS, PASS_PARTICLES, programParticle, drawParticles);
+	scene.setLocalBounds(particleEntity, vec3(-1e30f), vec3(1e30f));
+}
+
+// The MaterialId materials
+void makeMaterials()
+{
+	const Material none = {};
+	const Material axis = { vec4(1.0, 0.0, 0.0, 1.0), vec4(0.0), vec4(0.0), 0.0f };
+	const Material floor = { vec4(0.2, 0.2, 0.2, 1.0), vec4(0.0, 1.0, 0.0, 1.0), vec4(0.0, 0.0, 0.0, 1.0), 0.0f };
+	const Material ball = { vec4(0.2, 0.2, 0.2, 1.0), vec4(1.0, 0.84, 0.0, 1.0), vec4(1.0, 0.84, 0.0, 1.0), 125.f };
+	materials.create(GL_TEXTURE4);
+	materials.add(none);
+	materials.add(axis);
+	materials.add(floor);
+	materials.add(ball);
+}
+
+// Material system: the entities' switches and polygon modes from
+// the ...Flag globals.  Runs when they change, not every frame; whether the
+// shadow map exists is added per frame by submitScene().
+void applySettings()
+{
+	int lighting = lightingFlag ? SW_LIGHTING : 0;
+	int shading = shadingFlag ? SW_SHADING : 0;
+
+	if (sphereFlag != 1) { // Filled sphere
+		scene.polygonMode[ballEntity] = GL_FILL;
+		scene.switches[ballEntity] = lighting | shading | (latticeFlag ? SW_LATTICE : 0) |
+			spheretexFlag << SW_SPHERE_TEXTURE_SHIFT;
+		scene.flags[ballEntity] |= ENTITY_RECEIVER;
+	}
+	else {                 // Wireframe sphere
+		scene.polygonMode[ballEntity] = GL_LINE;
+		scene.switches[ballEntity] = shading;
+		scene.flags[ballEntity] &= ~ENTITY_RECEIVER;
+	}
+
+	scene.polygonMode[floorEntity] = floorFlag == 1 ? GL_FILL : GL_LINE;
+	scene.switches[floorEntity] = lighting | (groundtexFlag ? SW_FLOOR_TEXTURE : 0);
+}
+
+// The balls of "balls" that can show in this frame, into visibleBalls:
+// those whose bounding spheres reach into the view or, with shadows, into
+// the light's view, where they can still throw a shadow into the picture.
+// Both passes draw the same instances.
+InstanceData visibleBalls;
+void cullBalls(const InstanceData& balls, const ViewFrustum& view, const ViewFrustum* light)
+{
+	int n = balls.size(), count = 0;
+	GLfloat r = sphere.radius;
+	visibleBalls.resize(n);
+	for (int i = 0; i < n; i++) {
+		const vec4* t = &balls.texels[size_t(i) * InstanceData::Texels];
+		vec3 center(t[0].w, t[1].w, t[2].w);
+		if (view.testSphere(center, r) == ViewFrustum::Outside &&
+			(!light || light->testSphere(center, r) == ViewFrustum::Outside))
+			continue;
+		std::copy(t, t + InstanceData::Texels, &visibleBalls.texels[size_t(count++) * InstanceData::Texels]);
+	}
+	visibleBalls.resize(count);
+}
+
+// Entities found by scene.cull(), reused every frame
+std::vector<Scene::Entity> entitiesInView, entitiesInLight;
+
+// The DrawCall of entity i for its own pass
+DrawCall entityCall(Scene::Entity i, bool shadowing)
+{
+	DrawCall call = DrawCall();
+	call.program = scene.program[i];
+	call.texture = scene.texture[i];
+	call.polygonMode = scene.polygonMode[i];
+	call.switches = scene.switches[i] | (shadowing && (scene.flags[i] & ENTITY_RECEIVER) ? SW_SHADOW : 0);
+	call.obj = scene.mesh[i];
+	call.mode = scene.mode[i];
+	call.model = scene.model[i];
+	call.instances = scene.instances[i];
+	call.draw = scene.draw[i];
+	call.batch = scene.batch[i];
+	return call;
+}
+
+// Queue the visible entities in the view volume, in entity order, into
+// their passes, and the casters in the light's view volume (which may be
+// out of view but still shadow something in it) into the shadow map pass
+void submitScene(bool shadowing)
+{
+	entitiesInView.clear();
+	scene.cull(ViewFrustum(frameProjection * frameCamera), entitiesInView);
+	for (size_t k = 0; k < entitiesInView.size(); k++) {
+		Scene::Entity i = entitiesInView[k];
+		if (!(scene.flags[i] & ENTITY_VISIBLE))
+			continue;
+		DrawCall call = entityCall(i, shadowing);
+		submitPass(RenderPass(scene.pass[i]), call, viewDepth(call.model));
+	}
+	if (!shadowing)
+		return;
+
+	entitiesInLight.clear();
+	scene.cull(ViewFrustum(frameLight), entitiesInLight);
+	for (size_t k = 0; k < entitiesInLight.size(); k++) {
+		Scene::Entity i = entitiesInLight[k];
+		if ((scene.flags[i] & (ENTITY_VISIBLE | ENTITY_CASTER)) != (ENTITY_VISIBLE | ENTITY_CASTER))
+			continue;
+		DrawCall call = entityCall(i, shadowing);
+		call.program = programDepth;
+		call.texture = 0;
+		call.draw = drawDepth;
+		call.batch = NULL;
+		submitPass(PASS_SHADOW_MAP, call, viewDepth(call.model));
 	}
-	mat4 currentRot = Roll(distanceDelta, angleDelta, radius);
-	return Translate(a + (distanceDelta * progress)) * currentRot * savedRot;
 }
 
 //----------------------------------------------------------------------------
 void display( void )
 {
-	GLuint  model_view;  // model-view matrix uniform shader variable location
 	GLuint  projection;  // projection matrix uniform shader variable location
 	GLuint  camera;  // look-at matrix uniform shader variable location
 
-    glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+    glState.beginFrame();
+
+	// Passes whose program the driver is still building wait for a later
+	// frame instead of stalling this one in finishProgram()
+	bool shadowing = shadowFlag && eye[1] > 0.f && shadowMapFramebuffer != 0 &&
+		ShaderReady(programDepth);
+	frameGraph.enable(PASS_SHADOW_MAP, shadowing);
+	frameGraph.enable(PASS_PARTICLES, fireworkFlag != 0 && ShaderReady(programParticle));
+	frameGraph.compile();
+
+	// Every target of a running pass is cleared now, once, even if
+	// culling leaves it without draws: an empty view still shows no stale
+	// picture, and a shadow map without casters holds no old shadows
+	RenderTarget window = { 0, 0, 0, winWidth, winHeight, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT };
+	RenderTarget shadowMap = { shadowMapFramebuffer, 0, 0, shadowMapSize, shadowMapSize, GL_DEPTH_BUFFER_BIT };
+	bool windowCleared = false;
+	for (int pass = 0; pass < PASS_COUNT; ++pass) {
+		if (!frameGraph.runs(pass))
+			continue;
+		const RenderTarget& target = pass == PASS_SHADOW_MAP ? shadowMap : window;
+		renderQueue.setTarget(frameGraph.slot(pass), target);
+		if (&target == &shadowMap)
+			RenderQueue::clearTarget(shadowMap);
+		else if (!windowCleared) {
+			RenderQueue::clearTarget(window);
+			windowCleared = true;
+		}
+	}
 
-    glUseProgram(program); // Use the shader program
+	// Without the main program nothing can draw; show the cleared window
+	// and try again next frame
+	if (!ShaderReady(program)) {
+		glutSwapBuffers();
+		glutPostRedisplay();
+		return;
+	}
+
+	// The newest complete simulation step
+	const FrameState& frame = frames.front();
+	scene.setLocalBounds(ballEntity, frame.ballsMin, frame.ballsMax);
+	if (frame.burst != uploadedBurst) {
+		uploadParticles(particles, frame.particleVelocity, frame.particleColor);
+		uploadedBurst = frame.burst;
+	}
+	frameParticleTime = frame.particleTime;
+
+	frameLight = lightMatrix();
+	if (shadowing) {
+		finishProgram(programDepth);
+		glState.useProgram(programDepth);
+		glUniformMatrix4fv(glGetUniformLocation(programDepth, "light_matrix"), 1, GL_TRUE, frameLight);
+		glUniform1i(glGetUniformLocation(programDepth, "instances"), 2);
+		glUniform1i(glGetUniformLocation(programDepth, "f_latticeType"), latticeModeFlag);
+	}
 
-    model_view = glGetUniformLocation(program, "model_view" );
+	finishProgram(program); // no-op once the program is built
+    glState.useProgram(program); // Use the shader program
+
+    modelViewLoc = glGetUniformLocation(program, "model_view" );
+	materialLoc = glGetUniformLocation(program, "material");
 	projection = glGetUniformLocation(program, "projection");
 	camera = glGetUniformLocation(program, "camera");
 /*---  Set up and pass on Projection matrix to the shader ---*/
-    mat4  p = Perspective(fovy, aspect, zNear, zFar);
-    glUniformMatrix4fv(projection, 1, GL_TRUE, p); // GL_TRUE: matrix is row-major
+    frameProjection = Perspective(fovy, aspect, zNear, zFar);
+    glUniformMatrix4fv(projection, 1, GL_TRUE, frameProjection); // GL_TRUE: matrix is row-major
 
 /*---  Set up and pass on Model-View matrix to the shader ---*/
     // eye is a global variable of vec4 set to init_eye and updated by keyboard()
-	mat4  mv;
 	vec4    at(0.0, 0.0, 0.0, 1.0);
     vec4    up(0.0, 1.0, 0.0, 0.0);
-	mat4 la = LookAt(eye, at, up);
-	glUniformMatrix4fv(camera, 1, GL_TRUE, la); // GL_TRUE: matrix is row-major
+	frameCamera = LookAt(eye, at, up);
+	glUniformMatrix4fv(camera, 1, GL_TRUE, frameCamera); // GL_TRUE: matrix is row-major
 	glUniform4f(glGetUniformLocation(program, "point_light"), light_source.x, light_source.y, light_source.z, light_source.w);
-	glUniform1i(glGetUniformLocation(program, "f_lighting"), lightingFlag);
 	glUniform1i(glGetUniformLocation(program, "f_spotlight"), sourceFlag);
 	glUniform1i(glGetUniformLocation(program, "f_fog"), fogFlag);
 	glUniform1i(glGetUniformLocation(program, "f_relTexture"), texFrameFlag);
 	glUniform1i(glGetUniformLocation(program, "f_tiltTexture"), tiltTextureFlag);
 	glUniform1i(glGetUniformLocation(program, "f_latticeType"), latticeModeFlag);
-
-
-	/*----- Set Up the Model-View matrix for the sphere -----*/
-	mv = ballMatrix;
-	glUniformMatrix4fv(model_view, 1, GL_TRUE, mv); // GL_TRUE: matrix is row-major
-	if (sphereFlag != 1) {// Filled sphere
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-		glUniform1i(glGetUniformLocation(program, "f_lattice"), latticeFlag);
-		glUniform1i(glGetUniformLocation(program, "f_sphereTexture"), spheretexFlag);
-	}
-	else {            // Wireframe sphere
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		glUniform1i(glGetUniformLocation(program, "f_lighting"), GL_FALSE);
-	}
-	glUniform1i(glGetUniformLocation(program, "f_shading"), shadingFlag);
-	drawObj(sphere, GL_TRIANGLES);  // draw the sphere
-	glUniform1i(glGetUniformLocation(program, "f_sphereTexture"), 0);
-	glUniform1i(glGetUniformLocation(program, "f_lighting"), lightingFlag);
-	glUniform1i(glGetUniformLocation(program, "f_shading"), GL_FALSE);
-	glUniform1i(glGetUniformLocation(program, "f_lattice"), GL_FALSE);
-
-
-	/*----- Set up the Mode-View matrix for the floor -----*/
-	mv = mat4(1.f);
-
-    glUniformMatrix4fv(model_view, 1, GL_TRUE, mv); // GL_TRUE: matrix is row-major
-	glUniform1i(glGetUniformLocation(program, "floorTexture"), groundtexFlag);
-	if (groundtexFlag)
-		glBindTexture(GL_TEXTURE_2D, checkerTexture);
-    if (floorFlag == 1) // Filled floor
-       glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    else              // Wireframe floor
-       glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	glDepthMask(GL_FALSE);
-	drawObj(floor_buf, GL_TRIANGLES);  // draw the floor
-	glUniform1i(glGetUniformLocation(program, "floorTexture"), GL_FALSE);
-	if (shadowFlag && eye[1] > 0.f) {
-		if (blendingFlag) 
-			glEnable(GL_BLEND);
-		mv = shadowMatrix() * ballMatrix;
-		glUniformMatrix4fv(model_view, 1, GL_TRUE, mv); 
-		if (sphereFlag != 1) { // Filled sphere
-			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-			glUniform1i(glGetUniformLocation(program, "f_lattice"), latticeFlag);
-		}
-		else				 // Wireframe sphere
-			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		glUniform1i(glGetUniformLocation(program, "f_lighting"), GL_FALSE);
-		drawObj(sphere_shadow, GL_TRIANGLES);
-		glUniform1i(glGetUniformLocation(program, "f_lattice"), GL_FALSE);
-		glUniform1i(glGetUniformLocation(program, "f_lighting"), lightingFlag);
-		glDisable(GL_BLEND);
-	}
-	glDepthMask(GL_TRUE);
-	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-	drawObj(floor_buf, GL_TRIANGLES);  // draw the floor
-	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-
-	/*----- Set up the Mode-View matrix for the axis -----*/
-	mv = Scale(10.0f);
-	glUniformMatrix4fv(model_view, 1, GL_TRUE, mv); // GL_TRUE: matrix is row-major
-	glUniform1i(glGetUniformLocation(program, "f_lighting"), GL_FALSE);
-	drawObj(axis, GL_LINES);
-	glUniform1i(glGetUniformLocation(program, "f_lighting"), lightingFlag);
-
-	if (fireworkFlag) {
-		glUseProgram(programParticle);
-		glUniformMatrix4fv(glGetUniformLocation(program, "model_view"), 1, GL_TRUE, la);;
-		glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_TRUE, p);;
-		glBindBuffer(GL_ARRAY_BUFFER, particles.id);
-
-		float delta = (float)glutGet(GLUT_ELAPSED_TIME) - initialTime;
-		std::cout << delta << std::endl;
-		glUniform1f(glGetUniformLocation(programParticle, "time"), delta);
-		GLuint v = glGetAttribLocation(programParticle, "vVelocity");
-		glEnableVertexAttribArray(v);
-		glVertexAttribPointer(v, 3, GL_FLOAT, GL_FALSE, 0,
-			BUFFER_OFFSET(0));
-
-		GLuint c = glGetAttribLocation(programParticle, "vColor");
-		glEnableVertexAttribArray(c);
-		glVertexAttribPointer(c, 4, GL_FLOAT, GL_FALSE, 0,
-			BUFFER_OFFSET(sizeof(vec3) * particles.size));
-		// point size = 3.0
-		glPointSize(3.0);
-		glDrawArrays(GL_POINTS, 0, particles.size);
-
-		glDisableVertexAttribArray(v);
-		glDisableVertexAttribArray(c);
-	}
+	mat4 shadowLookup = shadow_bias * frameLight;
+	glUniformMatrix4fv(glGetUniformLocation(program, "light_matrix"), 1, GL_TRUE, shadowLookup);
+	glUniform1i(glGetUniformLocation(program, "shadowMap"), 1);
+	glUniform1i(glGetUniformLocation(program, "instances"), 2);
+	glUniform1i(glGetUniformLocation(program, "drawData"), 3);
+	glUniform1i(glGetUniformLocation(program, "materials"), 4);
+	glUniform1i(glGetUniformLocation(program, "checkerTex"), 5);
+	glUniform1i(glGetUniformLocation(program, "stripeTex"), 6);
+	materials.upload(); // only after set()s
+	glUniform4f(glGetUniformLocation(program, "shadow_color"), shadow_color.x, shadow_color.y, shadow_color.z,
+		blendingFlag ? shadow_color.w : 1.0f);
+	appliedSwitches = -1;
+
+	if (frameGraph.runs(PASS_PARTICLES))
+		finishProgram(programParticle);
+
+	// Only the balls that can show; none left hides the entity, as 0
+	// instances would draw it once, uninstanced
+	ViewFrustum light(frameLight);
+	cullBalls(frame.balls, ViewFrustum(frameProjection * frameCamera), shadowing ? &light : NULL);
+	ballInstances.upload(visibleBalls);
+	scene.instances[ballEntity] = visibleBalls.size();
+	if (visibleBalls.size() > 0)
+		scene.flags[ballEntity] |= ENTITY_VISIBLE;
+	else
+		scene.flags[ballEntity] &= ~ENTITY_VISIBLE;
+
+	renderQueue.clear();
+	multiDrawCalls = multiDrawDraws = 0;
+	scene.updateTransforms();
+	submitScene(shadowing);
+
+	renderQueue.sort();
+	renderQueue.execute();
 
     glutSwapBuffers();
 }
 
-#define ANIMATION_T 1500.f
 //---------------------------------------------------------------------------
+// Redraw only when the simulation thread has published a new step
 void idle (void)
 {
-	if (rollFlag)
-		angleCounter += 0.001f; //roll speed
-	ballMatrix = RollAnimation(angleCounter);
-	float delta = (float)glutGet(GLUT_ELAPSED_TIME) - initialTime;
-	if (delta > ANIMATION_T) startParticles(particles);
-    glutPostRedisplay();
+	if (frames.update())
+		glutPostRedisplay();
 }
 
 //----------------------------------------------------------------------------
@@ -540,6 +1278,7 @@ void keyboard(unsigned char key, int x, int y)
     switch(key) {
 	case 033: // Escape Key
 	case 'q': case 'Q':
+	    releaseResources();
 	    exit( EXIT_SUCCESS );
 	    break;
 
@@ -551,6 +1290,7 @@ void keyboard(unsigned char key, int x, int y)
 	case 'z': eye[2] -= 1.0; break;
 
         case 'b': case 'B': // Toggle between animation and non-animation
+			startSimulation();
 			glutIdleFunc(idle);
             break;
 	   
@@ -591,17 +1331,39 @@ void keyboard(unsigned char key, int x, int y)
 			break;
 
 
+		case '+': // Twice as many balls
+			ballCount = ballCount * 2 > MaxBalls ? MaxBalls : ballCount * 2;
+			if (!simRunning) publishStill();
+			printf("%d balls\n", int(ballCount));
+			break;
+
+		case '-': // Half as many balls
+			ballCount = ballCount > 1 ? ballCount / 2 : 1;
+			if (!simRunning) publishStill();
+			printf("%d balls\n", int(ballCount));
+			break;
+
+		case 'i': case 'I': // Print GL state cache statistics of the last frame
+			printf("GL state calls: %u issued, %u filtered\n",
+				glState.lastIssued, glState.lastFiltered);
+			printf("Frame graph: %d passes run, %d culled, %d merged, %d cyclic\n",
+				frameGraph.executed, frameGraph.culled, frameGraph.merged, frameGraph.cyclic);
+			printf("Multi-draw: %d calls, %d draws\n", multiDrawCalls, multiDrawDraws);
+			break;
+
 	case ' ':  // reset to initial viewer/eye position
 	    eye = init_eye;
 	    break;
     }
+    applySettings();
     glutPostRedisplay();
 }
 
 //----------------------------------------------------------------------------
 void menu(int choice) {
 	switch (choice) {
-	case MENU_QUIT:
+	case MENU_QUIT: // as 'q': free the GL objects while the context exists
+		releaseResources();
 		exit(EXIT_SUCCESS);
 	case MENU_VIEW_DEFAULT:
 		rollFlag = 1; //roll ball
@@ -674,20 +1436,48 @@ void menu(int choice) {
 		fireworkFlag = 0;
 		break;
 	}
+	applySettings();
 }
 
 //----------------------------------------------------------------------------
 void reshape(int width, int height)
 {
-    glViewport(0, 0, width, height);
+    winWidth = width;
+    winHeight = height;
     aspect = (GLfloat) width  / (GLfloat) height;
     glutPostRedisplay();
 }
 
 //----------------------------------------------------------------------------
+void stopJobs() { jobSystem.stop(); }
+
+// Delete the GL objects while the context still exists
+void releaseResources()
+{
+	stopSimulation();
+	stopJobs();
+	program.reset();
+	programParticle.reset();
+	programDepth.reset();
+	checkerTexture.reset();
+	stripeTexture.reset();
+	shadowMapTexture.reset();
+	shadowMapFramebuffer.reset();
+	particleBuffer.reset();
+	ballInstances.release();
+	drawData.release();
+	materials.release();
+	drawIds.reset();
+	drawCommands.reset();
+	vertexPool.clear();
+}
+
 int main( int argc, char **argv )
 {
     glutInit(&argc, argv);
+    jobSystem.start(); // one worker per hardware thread but this one
+    atexit(stopJobs);  // before the globals the jobs use go away
+    if (argc > 1) meshFile = argv[1]; // ball mesh, sphere.1024 by default
 #ifdef __APPLE__ // Enable core profile of OpenGL 3.2 on macOS.
     glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH | GLUT_3_2_CORE_PROFILE);
 #else
@@ -698,8 +1488,7 @@ int main( int argc, char **argv )
 
 #ifdef __APPLE__ // on macOS
     // Core profile requires to create a Vertex Array Object (VAO).
-    GLuint vao;
-    glGenVertexArrays(1, &vao);
+    static GLVertexArray vao = GLVertexArray::create();
     glBindVertexArray(vao);
 #else           // on Linux or Windows, we still need glew
     /* Call glewInit() and error checking */
@@ -717,7 +1506,6 @@ int main( int argc, char **argv )
 
     glutDisplayFunc(display);
     glutReshapeFunc(reshape);
-	ballMatrix = RollAnimation(0.f); //calculate transformations once
     //glutIdleFunc(idle);
     glutKeyboardFunc(keyboard);
 	glutMouseFunc(mouse);
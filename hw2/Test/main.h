@@ -0,0 +1,39 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- main.h ---
+//
+//   Types shared between main.cpp and the hw2 rendering modules.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __MAIN_H__
+#define __MAIN_H__
+
+#include "Angel-yjc.h"
+
+typedef Angel::vec4  color4;
+typedef Angel::vec3  point3;
+
+// One vertex of a static mesh.  Meshes are arrays of these, so the
+// meshes sharing a buffer also share one set of attribute pointers and a
+// mesh is just a range of vertices.  The color comes first so the
+// 16-byte aligned vec4 needs no padding: 48 bytes.
+struct Vertex {
+	color4 color;
+	point3 point;
+	vec3   normal;
+	vec2   uv;
+};
+const size_t VertexBytes = sizeof(Vertex);
+
+// Utility type for passing VBOs to render
+struct ObjBuffer {
+	GLuint id;        // buffer, usually a page of vertexPool
+	int size;
+	int material;  // index into the MaterialTable, also groups draws by material
+	vec3 boundsMin, boundsMax;  // object-space bounding box
+	float radius;               // bounding sphere about the object-space origin
+	GLintptr offset;            // of the mesh's block in buffer id, a multiple of VertexBytes
+};
+
+#endif // __MAIN_H__
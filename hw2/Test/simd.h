@@ -0,0 +1,54 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- simd.h ---
+//
+//   Selects the instruction set behind vec4 and mat4 (vec.h and
+//   mat-yjc-new.h):
+//
+//     ANGEL_SIMD_SSE  SSE: one vec4 / matrix row per instruction
+//     ANGEL_SIMD_AVX  AVX: two matrix rows per instruction in mat4 * mat4
+//                     (only with -mavx or /arch:AVX; implies SSE)
+//
+//   Neither is defined on other targets (e.g. ARM Macs) or when
+//   ANGEL_NO_SIMD is defined, and the scalar code is used.
+//
+//   vec4 (and so mat4) is 16-byte aligned, but all loads and stores are
+//   the unaligned kind: vec4 arrays from new[] or in vertex buffers need
+//   not be aligned, and on current CPUs the unaligned instructions cost
+//   nothing extra on aligned data.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ANGEL_SIMD_H__
+#define __ANGEL_SIMD_H__
+
+#ifndef ANGEL_NO_SIMD
+#  if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#    define ANGEL_SIMD_SSE
+#    include <xmmintrin.h>
+#  endif
+#  if defined(ANGEL_SIMD_SSE) && defined(__AVX__)
+#    define ANGEL_SIMD_AVX
+#    include <immintrin.h>
+#  endif
+#endif // ANGEL_NO_SIMD
+
+#ifdef ANGEL_SIMD_SSE
+
+namespace Angel {
+
+// Sum of the four lanes of v, in every lane
+inline __m128 simd_hsum( __m128 v )
+{
+    __m128 t = _mm_add_ps( v, _mm_shuffle_ps( v, v, _MM_SHUFFLE(2, 3, 0, 1) ) );
+    return _mm_add_ps( t, _mm_shuffle_ps( t, t, _MM_SHUFFLE(1, 0, 3, 2) ) );
+}
+
+// Lane i of v in every lane
+#define ANGEL_SIMD_SPLAT( v, i ) _mm_shuffle_ps( (v), (v), _MM_SHUFFLE(i, i, i, i) )
+
+}  // namespace Angel
+
+#endif // ANGEL_SIMD_SSE
+
+#endif // __ANGEL_SIMD_H__
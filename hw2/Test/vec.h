@@ -8,6 +8,7 @@
 #define __ANGEL_VEC_H__
 
 #include "Angel-yjc.h"
+#include "simd.h"
 
 namespace Angel {
 
@@ -25,14 +26,14 @@ struct vec2 {
     //  --- Constructors and Destructors ---
     //
 
-    vec2( GLfloat s = GLfloat(0.0) ) :
+    constexpr vec2( GLfloat s = GLfloat(0.0) ) :
 	x(s), y(s) {}
 
-    vec2( GLfloat x, GLfloat y ) :
+    constexpr vec2( GLfloat x, GLfloat y ) :
 	x(x), y(y) {}
 
-    vec2( const vec2& v )
-	{ x = v.x;  y = v.y;  }
+    constexpr vec2( const vec2& v ) :
+	x(v.x), y(v.y) {}
 
     //
     //  --- Indexing Operator ---
@@ -45,22 +46,22 @@ struct vec2 {
     //  --- (non-modifying) Arithematic Operators ---
     //
 
-    vec2 operator - () const // unary minus operator
+    constexpr vec2 operator - () const // unary minus operator
 	{ return vec2( -x, -y ); }
 
-    vec2 operator + ( const vec2& v ) const
+    constexpr vec2 operator + ( const vec2& v ) const
 	{ return vec2( x + v.x, y + v.y ); }
 
-    vec2 operator - ( const vec2& v ) const
+    constexpr vec2 operator - ( const vec2& v ) const
 	{ return vec2( x - v.x, y - v.y ); }
 
-    vec2 operator * ( const GLfloat s ) const
+    constexpr vec2 operator * ( const GLfloat s ) const
 	{ return vec2( s*x, s*y ); }
 
-    vec2 operator * ( const vec2& v ) const
+    constexpr vec2 operator * ( const vec2& v ) const
 	{ return vec2( x*v.x, y*v.y ); }
 
-    friend vec2 operator * ( const GLfloat s, const vec2& v )
+    friend constexpr vec2 operator * ( const GLfloat s, const vec2& v )
 	{ return v * s; }
 
     vec2 operator / ( const GLfloat s ) const {
@@ -133,7 +134,7 @@ struct vec2 {
 //  Non-class vec2 Methods
 //
 
-inline
+inline constexpr
 GLfloat dot( const vec2& u, const vec2& v ) {
     return u.x * v.x + u.y * v.y;
 }
@@ -164,15 +165,17 @@ struct vec3 {
     //  --- Constructors and Destructors ---
     //
 
-    vec3( GLfloat s = GLfloat(0.0) ) :
+    constexpr vec3( GLfloat s = GLfloat(0.0) ) :
 	x(s), y(s), z(s) {}
 
-    vec3( GLfloat x, GLfloat y, GLfloat z ) :
+    constexpr vec3( GLfloat x, GLfloat y, GLfloat z ) :
 	x(x), y(y), z(z) {}
 
-    vec3( const vec3& v ) { x = v.x;  y = v.y;  z = v.z; }
+    constexpr vec3( const vec3& v ) :
+	x(v.x), y(v.y), z(v.z) {}
 
-    vec3( const vec2& v, const float f ) { x = v.x;  y = v.y;  z = f; }
+    constexpr vec3( const vec2& v, const float f ) :
+	x(v.x), y(v.y), z(f) {}
 
     //
     //  --- Indexing Operator ---
@@ -185,22 +188,22 @@ struct vec3 {
     //  --- (non-modifying) Arithematic Operators ---
     //
 
-    vec3 operator - () const  // unary minus operator
+    constexpr vec3 operator - () const  // unary minus operator
 	{ return vec3( -x, -y, -z ); }
 
-    vec3 operator + ( const vec3& v ) const
+    constexpr vec3 operator + ( const vec3& v ) const
 	{ return vec3( x + v.x, y + v.y, z + v.z ); }
 
-    vec3 operator - ( const vec3& v ) const
+    constexpr vec3 operator - ( const vec3& v ) const
 	{ return vec3( x - v.x, y - v.y, z - v.z ); }
 
-    vec3 operator * ( const GLfloat s ) const
+    constexpr vec3 operator * ( const GLfloat s ) const
 	{ return vec3( s*x, s*y, s*z ); }
 
-    vec3 operator * ( const vec3& v ) const
+    constexpr vec3 operator * ( const vec3& v ) const
 	{ return vec3( x*v.x, y*v.y, z*v.z ); }
 
-    friend vec3 operator * ( const GLfloat s, const vec3& v )
+    friend constexpr vec3 operator * ( const GLfloat s, const vec3& v )
 	{ return v * s; }
 
     vec3 operator / ( const GLfloat s ) const {
@@ -273,7 +276,7 @@ struct vec3 {
 //  Non-class vec3 Methods
 //
 
-inline
+inline constexpr
 GLfloat dot( const vec3& u, const vec3& v ) {
     return u.x*v.x + u.y*v.y + u.z*v.z ;
 }
@@ -288,7 +291,7 @@ vec3 normalize( const vec3& v ) {
     return v / length(v);
 }
 
-inline
+inline constexpr
 vec3 cross(const vec3& a, const vec3& b )
 {
     return vec3( a.y * b.z - a.z * b.y,
@@ -303,7 +306,15 @@ vec3 cross(const vec3& a, const vec3& b )
 //
 //////////////////////////////////////////////////////////////////////////////
 
-struct vec4 {
+//   With ANGEL_SIMD_SSE the arithmetic works on all four components at
+//   once (see simd.h).  So unlike vec2 and vec3, only the constructors
+//   are constexpr.
+//
+//   Being 16-byte aligned, vec4 (and mat4) must not be a by-value function
+//   parameter: 32-bit MSVC rejects that (C2719).  Pass const references.
+//
+
+struct alignas(16) vec4 {
 
     GLfloat  x;
     GLfloat  y;
@@ -314,19 +325,26 @@ struct vec4 {
     //  --- Constructors and Destructors ---
     //
 
-    vec4( GLfloat s = GLfloat(0.0) ) :
+    constexpr vec4( GLfloat s = GLfloat(0.0) ) :
 	x(s), y(s), z(s), w(s) {}
 
-    vec4( GLfloat x, GLfloat y, GLfloat z, GLfloat w ) :
+    constexpr vec4( GLfloat x, GLfloat y, GLfloat z, GLfloat w ) :
 	x(x), y(y), z(z), w(w) {}
 
-    vec4( const vec4& v ) { x = v.x;  y = v.y;  z = v.z;  w = v.w; }
+    constexpr vec4( const vec4& v ) :
+	x(v.x), y(v.y), z(v.z), w(v.w) {}
+
+    constexpr vec4( const vec3& v, const float w = 1.0 ) :
+	x(v.x), y(v.y), z(v.z), w(w) {}
 
-    vec4( const vec3& v, const float w = 1.0 ) : w(w)
-	{ x = v.x;  y = v.y;  z = v.z; }
+    constexpr vec4( const vec2& v, const float z, const float w ) :
+	x(v.x), y(v.y), z(z), w(w) {}
 
-    vec4( const vec2& v, const float z, const float w ) : z(z), w(w)
-	{ x = v.x;  y = v.y; }
+#ifdef ANGEL_SIMD_SSE
+    explicit vec4( __m128 r ) { _mm_storeu_ps( &x, r ); }
+
+    __m128 load() const { return _mm_loadu_ps( &x ); }
+#endif
 
     //
     //  --- Indexing Operator ---
@@ -339,6 +357,22 @@ struct vec4 {
     //  --- (non-modifying) Arithematic Operators ---
     //
 
+#ifdef ANGEL_SIMD_SSE
+    vec4 operator - () const  // unary minus operator
+	{ return vec4( _mm_sub_ps( _mm_setzero_ps(), load() ) ); }
+
+    vec4 operator + ( const vec4& v ) const
+	{ return vec4( _mm_add_ps( load(), v.load() ) ); }
+
+    vec4 operator - ( const vec4& v ) const
+	{ return vec4( _mm_sub_ps( load(), v.load() ) ); }
+
+    vec4 operator * ( const GLfloat s ) const
+	{ return vec4( _mm_mul_ps( load(), _mm_set1_ps( s ) ) ); }
+
+    vec4 operator * ( const vec4& v ) const
+	{ return vec4( _mm_mul_ps( load(), v.load() ) ); }
+#else
     vec4 operator - () const  // unary minus operator
 	{ return vec4( -x, -y, -z, -w ); }
 
@@ -354,6 +388,7 @@ struct vec4 {
     vec4 operator * ( const vec4& v ) const
         { return vec4( x*v.x, y*v.y, z*v.z, w*v.w ); }  // YJC: Correct version
     //	{ return vec4( x*v.x, y*v.y, z*v.z, w*v.z ); }  // Wrong! Fixed as above
+#endif // ANGEL_SIMD_SSE
 
     friend vec4 operator * ( const GLfloat s, const vec4& v )
 	{ return v * s; }
@@ -375,6 +410,19 @@ struct vec4 {
     //  --- (modifying) Arithematic Operators ---
     //
 
+#ifdef ANGEL_SIMD_SSE
+    vec4& operator += ( const vec4& v )
+	{ _mm_storeu_ps( &x, _mm_add_ps( load(), v.load() ) );  return *this; }
+
+    vec4& operator -= ( const vec4& v )
+	{ _mm_storeu_ps( &x, _mm_sub_ps( load(), v.load() ) );  return *this; }
+
+    vec4& operator *= ( const GLfloat s )
+	{ _mm_storeu_ps( &x, _mm_mul_ps( load(), _mm_set1_ps( s ) ) );  return *this; }
+
+    vec4& operator *= ( const vec4& v )
+	{ _mm_storeu_ps( &x, _mm_mul_ps( load(), v.load() ) );  return *this; }
+#else
     vec4& operator += ( const vec4& v )
 	{ x += v.x;  y += v.y;  z += v.z;  w += v.w;  return *this; }
 
@@ -386,6 +434,7 @@ struct vec4 {
 
     vec4& operator *= ( const vec4& v )
 	{ x *= v.x, y *= v.y, z *= v.z, w *= v.w;  return *this; }
+#endif // ANGEL_SIMD_SSE
 
     vec4& operator /= ( const GLfloat s ) {
 #ifdef DEBUG
@@ -431,7 +480,11 @@ struct vec4 {
 
 inline
 GLfloat dot( const vec4& u, const vec4& v ) {
-    return u.x*v.x + u.y*v.y + u.z*v.z + u.w+v.w;
+#ifdef ANGEL_SIMD_SSE
+    return _mm_cvtss_f32( simd_hsum( _mm_mul_ps( u.load(), v.load() ) ) );
+#else
+    return u.x*v.x + u.y*v.y + u.z*v.z + u.w*v.w;  // was u.w+v.w
+#endif
 }
 
 inline
@@ -441,10 +494,17 @@ GLfloat length( const vec4& v ) {
 
 inline
 vec4 normalize( const vec4& v ) {
+#ifdef ANGEL_SIMD_SSE
+    // Same rounding as v / length(v): one sqrt, one reciprocal, one multiply
+    __m128 r = v.load();
+    __m128 len = _mm_sqrt_ps( simd_hsum( _mm_mul_ps( r, r ) ) );
+    return vec4( _mm_mul_ps( r, _mm_div_ps( _mm_set1_ps( 1.0f ), len ) ) );
+#else
     return v / length(v);
+#endif
 }
 
-inline
+inline constexpr
 vec3 cross(const vec4& a, const vec4& b )
 {
     return vec3( a.y * b.z - a.z * b.y,
@@ -5,18 +5,40 @@ in  vec3 vPosition;
 in  vec4 vColor;
 in  vec3 vNormal;
 in  vec2 vTexture;
+in  float vDrawId;   // multi-draw only: the draw's base instance
 out vec2 texcoord;
 out vec2 latcoord;
 out vec4 color;
 out float dist;
+out vec4 lightcoord;
+flat out int drawSwitches;   // the draw's switches, for the fragment shader
 
 uniform mat4 camera;
 uniform mat4 model_view;
 uniform mat4 projection;
+uniform mat4 light_matrix;   // shadow map lookup: bias * light projection * view
+
+// Feature switches, the ShaderSwitch bits of main.cpp.  The sphere texture
+// (0-2) is in bits 5-6.
+const int SW_LIGHTING = 1, SW_SHADING = 2, SW_LATTICE = 4, SW_INSTANCED = 128,
+	SW_MULTI_DRAW = 256;
+uniform int switches;
+
+// Instanced draws: per instance, 3 rows of the model transform and a
+// material tint (see InstanceBuffer.h)
+uniform samplerBuffer instances;
+
+// Multi-draw: per draw, 3 rows of the model transform, then the material
+// index and the draw's switches, at 4 * vDrawId (see drawMeshes() in
+// main.cpp)
+uniform samplerBuffer drawData;
+
+// Ambient, diffuse, specular and shininess of each material (see
+// MaterialTable.h); "material" picks one unless SW_MULTI_DRAW
+uniform samplerBuffer materials;
+uniform int material;
 
 uniform bool smooth_shading;
-uniform vec4 ambient, diffuse, specular;
-uniform float shininess;
 uniform vec4 global_illum = vec4(1.f,1.f,1.f,1.f);
 uniform vec4 dir_ambient = vec4(0, 0, 0, 1);
 uniform vec4 dir_diffuse = vec4(0.8, 0.8, 0.8, 1);
@@ -30,45 +52,66 @@ uniform vec4 point_to = vec4(-6,0,-4.5,1);
 uniform float spotlight_exp = 15;
 uniform float spotlight_cutoff = 20;
 
-uniform bool f_lighting = true;
-uniform bool f_shading = false;
 uniform bool f_spotlight = true;
 
-uniform int f_sphereTexture = 1;
 uniform int f_latticeType = 1;
-uniform bool f_lattice = false;
 uniform bool f_relTexture = true;
 uniform bool f_tiltTexture = true;
 
 void main() 
 {
 	vec4 vPosition4 = vec4(vPosition, 1.0);
-    gl_Position = projection * camera * model_view * vPosition4;
+	mat4 model = model_view;
+	vec4 tint = vec4(1.0);
+	int m = material;
+	int sw = switches;
+	if ((sw & SW_MULTI_DRAW) != 0) {
+		int i = 4 * int(vDrawId);
+		model = transpose(mat4(texelFetch(drawData, i), texelFetch(drawData, i + 1),
+			texelFetch(drawData, i + 2), vec4(0.0, 0.0, 0.0, 1.0)));
+		vec4 d = texelFetch(drawData, i + 3);
+		m = int(d.x);
+		sw = int(d.y) | SW_MULTI_DRAW;
+	}
+	drawSwitches = sw;
+	int f_sphereTexture = (sw >> 5) & 3;
+	if ((sw & SW_INSTANCED) != 0) {
+		int i = 4 * gl_InstanceID;
+		model = model_view * transpose(mat4(texelFetch(instances, i), texelFetch(instances, i + 1),
+			texelFetch(instances, i + 2), vec4(0.0, 0.0, 0.0, 1.0)));
+		tint = texelFetch(instances, i + 3);
+	}
+    gl_Position = projection * camera * model * vPosition4;
+	lightcoord = light_matrix * model * vPosition4;
 
-	if (!f_lighting) {
-		color = vColor;
+	if ((sw & SW_LIGHTING) == 0) {
+		color = vColor * tint;
 		return;
 	}
+	vec4 mat_ambient = texelFetch(materials, 4 * m) * tint;
+	vec4 mat_diffuse = texelFetch(materials, 4 * m + 1) * tint;
+	vec4 mat_specular = texelFetch(materials, 4 * m + 2);
+	float shininess = texelFetch(materials, 4 * m + 3).x;
 	
-	vec4 global_ambient = global_illum * ambient;
+	vec4 global_ambient = global_illum * mat_ambient;
 
-	vec3 Position = (camera * model_view * vPosition4).xyz;
+	vec3 Position = (camera * model * vPosition4).xyz;
 	vec3 Obj_Normal;
-	if (f_shading)
-		Obj_Normal = normalize( camera * model_view * vec4(vPosition, 0.0) ).xyz;
+	if ((sw & SW_SHADING) != 0)
+		Obj_Normal = normalize( camera * model * vec4(vPosition, 0.0) ).xyz;
 	else
-		Obj_Normal = normalize( camera * model_view * vec4(vNormal, 0.0) ).xyz;
+		Obj_Normal = normalize( camera * model * vec4(vNormal, 0.0) ).xyz;
     vec3 E = normalize( -Position );
 	if ( dot(Obj_Normal, E) < 0 ) Obj_Normal = -Obj_Normal;
 //	DIRECTIONAL LIGHT
     vec3 Light_Normal = normalize(-dir_light.xyz);
     vec3 H = normalize( Light_Normal + E );
 
-	vec4 directional_ambient = dir_ambient * ambient;
+	vec4 directional_ambient = dir_ambient * mat_ambient;
 	float d = max( dot(Light_Normal, Obj_Normal), 0.0 );
-	vec4 directional_diffuse = d * dir_diffuse * diffuse;
+	vec4 directional_diffuse = d * dir_diffuse * mat_diffuse;
     float s = pow( max(dot(Obj_Normal, H), 0.0), shininess );
-	vec4 directional_specular = s * dir_specular * specular;
+	vec4 directional_specular = s * dir_specular * mat_specular;
 
 	if( dot(Light_Normal, Obj_Normal) < 0.0 ) {
 		directional_specular = vec4(0.0, 0.0, 0.0, 1.0);
@@ -83,11 +126,11 @@ void main()
 	float dist_m = length(dist_v);
 	float attenuation = 1/(2 + 0.01 * dist_m + 0.001 * dist_m * dist_m);
 
-	vec4 pnt_ambient = point_ambient * ambient;
+	vec4 pnt_ambient = point_ambient * mat_ambient;
 	d = max( dot(Light_Normal, Obj_Normal), 0.0 );
-	vec4 pnt_diffuse = d * point_diffuse * diffuse;
+	vec4 pnt_diffuse = d * point_diffuse * mat_diffuse;
 	s = pow(max(dot(Obj_Normal, H), 0.0), shininess);
-	vec4 pnt_specular = s * point_specular * specular;
+	vec4 pnt_specular = s * point_specular * mat_specular;
 
 	if( dot(Light_Normal, Obj_Normal) < 0.0 ) {
 		pnt_specular = vec4(0.0, 0.0, 0.0, 1.0);
@@ -104,7 +147,7 @@ void main()
 	color += attenuation * (pnt_ambient + pnt_diffuse + pnt_specular);
 	dist = length(Position.xyz);
 
-	if (f_lattice){
+	if ((sw & SW_LATTICE) != 0){
 		if (f_latticeType == 1){
 			latcoord = vec2(0.5 * (vPosition4.x + 1), 0.5 * (vPosition4.y + 1));
 		}
@@ -121,7 +164,7 @@ void main()
 		if (f_relTexture){
 			pos = vPosition4;
 		} else {
-			pos = camera * model_view * vPosition4;
+			pos = camera * model * vPosition4;
 		}
 
 		if (f_sphereTexture == 1){
@@ -0,0 +1,33 @@
+#version 150 
+in  vec3 vPosition;
+out vec2 latcoord;
+
+uniform mat4 model_view;
+uniform mat4 light_matrix;   // light's projection * view
+uniform bool f_instanced = false;
+uniform samplerBuffer instances;  // as in vshader42.glsl
+
+uniform int f_latticeType = 1;
+uniform bool f_lattice = false;
+
+void main()
+{
+	vec4 vPosition4 = vec4(vPosition, 1.0);
+	mat4 model = model_view;
+	if (f_instanced) {
+		int i = 4 * gl_InstanceID;
+		model = model_view * transpose(mat4(texelFetch(instances, i), texelFetch(instances, i + 1),
+			texelFetch(instances, i + 2), vec4(0.0, 0.0, 0.0, 1.0)));
+	}
+	gl_Position = light_matrix * model * vPosition4;
+
+	// Same lattice as vshader42.glsl, so the holes cast no shadow
+	if (f_lattice){
+		if (f_latticeType == 1){
+			latcoord = vec2(0.5 * (vPosition4.x + 1), 0.5 * (vPosition4.y + 1));
+		}
+		else if (f_latticeType == 2) {
+			latcoord = vec2(0.3 * (vPosition4.x + vPosition4.y + vPosition4.z), 0.3 * (vPosition4.x - vPosition4.y + vPosition4.z));
+		}
+	}
+}